@@ -28,14 +28,9 @@ namespace Integro
 
 			static
 				json11::Json
-				MakeRequest(
-					const string &url
-					, const string &request
-					, const string &path
-					, stringstream &content)
+				ParseResponse(
+					const std::shared_ptr<HttpClient::Response> &httpResponse)
 			{
-				HttpClient client(url);
-				auto httpResponse = client.request(request, path, content);
 				stringstream s; s << httpResponse->content.rdbuf();
 				string error;
 				auto response = json11::Json::parse(s.str(), error);
@@ -65,6 +60,30 @@ namespace Integro
 				return response;
 			}
 
+			static
+				json11::Json
+				MakeRequest(
+					const string &url
+					, const string &request
+					, const string &path
+					, stringstream &content)
+			{
+				HttpClient client(url);
+				return ParseResponse(client.request(request, path, content));
+			}
+
+			static
+				json11::Json
+				MakeRequest(
+					const string &url
+					, const string &request
+					, const string &path
+					, const string &content)
+			{
+				HttpClient client(url);
+				return ParseResponse(client.request(request, path, content));
+			}
+
 		public:
 			static
 				void
@@ -76,21 +95,35 @@ namespace Integro
 					, const int maxBatchCount = 10000
 					, const int maxBatchSize = 100000000)
 			{
+				static const Mave::Mave none;
 				string request = "PUT";
 				string path = (index == "" ? "" : "/" + index + (type == "" ? "" : "/" + type)) + "/_bulk";
-				stringstream content;
+				string content;
 				int n = 0;
 
 				for (auto o = objects.begin(); o != objects.end(); ++o)
 				{
-					auto json = ToJson(*o);
-					content << "{\"index\":{\"_id\":\"" << json["_id"].string_value() << "\"}}" << endl;
-					content << json.dump() << endl;
+					// the id is taken only if it converts to a json string, as it did through json11
+					const auto &id = o->IsMap() && o->AsMap().count("_id") > 0 ? (*o)["_id"] : none;
+					content += "{\"index\":{\"_id\":";
+
+					if (id.IsString() || id.IsLong() || id.IsMilliseconds() || id.IsCustom())
+					{
+						Mave::ToJson(id, content);
+					}
+					else
+					{
+						content += "\"\"";
+					}
+
+					content += "}}\n";
+					Mave::ToJson(*o, content);
+					content += '\n';
 
-					if (++n == maxBatchCount || 1 + o == objects.end() || content.tellp() >= maxBatchSize)
+					if (++n == maxBatchCount || 1 + o == objects.end() || content.size() >= (size_t)maxBatchSize)
 					{
 						auto response = MakeRequest(url, request, path, content);
-						content.str("");
+						content.clear();
 						n = 0;
 					}
 				}
@@ -1,6 +1,8 @@
 #pragma once
 
 #include <string>
+#include <vector>
+#include <utility>
 #include <functional>
 
 #include "build_compability_includes/real/win32compability.h"
@@ -11,6 +13,8 @@ namespace Integro
 	namespace Access
 	{
 		using std::string;
+		using std::vector;
+		using std::pair;
 		using std::exception;
 		using std::function;
 
@@ -196,6 +200,252 @@ namespace Integro
 				mdb_env_close(env);
 			}
 
+			// looks keys up in one transaction, keys may contain any bytes,
+			// OnKeyValue is called for the keys that are present
+			static
+				void
+				Get(
+					const string &path
+					, const vector<string> &keys
+					, function<void(const string &key, const string &value)> OnKeyValue)
+			{
+				int rc = 0;
+				MDB_env *env = NULL;
+				MDB_dbi dbi = 0;
+				MDB_txn *txn = NULL;
+				MDB_val key_p, data_p;
+				key_p.mv_data = NULL;
+				key_p.mv_size = 0;
+				data_p.mv_data = NULL;
+				data_p.mv_size = 0;
+
+				rc = mdb_env_create(&env);
+
+				if (rc != 0)
+				{
+					mdb_env_close(env);
+					throw exception("LmdbClient::Get(): failed to create an environment");
+				}
+
+				rc = mdb_env_open(env, path.c_str(), 0, 0664);
+
+				if (rc != 0)
+				{
+					mdb_env_close(env);
+					throw exception("LmdbClient::Get(): failed to open an environment");
+				}
+
+				rc = mdb_txn_begin(env, NULL, MDB_RDONLY, &txn);
+
+				if (rc != 0)
+				{
+					mdb_txn_abort(txn);
+					mdb_env_close(env);
+					throw exception("LmdbClient::Get(): failed to begin a transaction");
+				}
+
+				rc = mdb_open(txn, NULL, 0, &dbi);
+
+				if (rc != 0)
+				{
+					mdb_txn_abort(txn);
+					mdb_close(env, dbi);
+					mdb_env_close(env);
+					throw exception("LmdbClient::Get(): failed to open a database");
+				}
+
+				try
+				{
+					for (auto &key : keys)
+					{
+						key_p.mv_data = (void*)key.data();
+						key_p.mv_size = key.size();
+
+						if (mdb_get(txn, dbi, &key_p, &data_p) == 0)
+						{
+							OnKeyValue(key, string((const char*)data_p.mv_data, data_p.mv_size));
+						}
+					}
+				}
+				catch (...)
+				{
+					mdb_txn_abort(txn);
+					mdb_close(env, dbi);
+					mdb_env_close(env);
+					throw;
+				}
+
+				mdb_txn_abort(txn);
+				mdb_close(env, dbi);
+				mdb_env_close(env);
+			}
+
+			// sets values of keys in one transaction, keys and values may contain any bytes,
+			// mapSize is the largest size of the database in bytes, 0 keeps the current one
+			static
+				void
+				Set(
+					const string &path
+					, const vector<pair<string, string>> &keyValues
+					, const size_t mapSize = 0)
+			{
+				int rc = 0;
+				MDB_env *env = NULL;
+				MDB_dbi dbi = 0;
+				MDB_txn *txn = NULL;
+				MDB_val key_p, data_p;
+				key_p.mv_data = NULL;
+				key_p.mv_size = 0;
+				data_p.mv_data = NULL;
+				data_p.mv_size = 0;
+
+				rc = mdb_env_create(&env);
+
+				if (rc != 0)
+				{
+					mdb_env_close(env);
+					throw exception("LmdbClient::Set(): failed to create an environment");
+				}
+
+				rc = mapSize == 0 ? 0 : mdb_env_set_mapsize(env, mapSize);
+
+				if (rc != 0)
+				{
+					mdb_env_close(env);
+					throw exception("LmdbClient::Set(): failed to set the map size");
+				}
+
+				rc = mdb_env_open(env, path.c_str(), 0, 0664);
+
+				if (rc != 0)
+				{
+					mdb_env_close(env);
+					throw exception("LmdbClient::Set(): failed to open an environment");
+				}
+
+				rc = mdb_txn_begin(env, NULL, 0, &txn);
+
+				if (rc != 0)
+				{
+					mdb_txn_abort(txn);
+					mdb_env_close(env);
+					throw exception("LmdbClient::Set(): failed to begin a transaction");
+				}
+
+				rc = mdb_open(txn, NULL, 0, &dbi);
+
+				if (rc != 0)
+				{
+					mdb_txn_abort(txn);
+					mdb_close(env, dbi);
+					mdb_env_close(env);
+					throw exception("LmdbClient::Set(): failed to open a database");
+				}
+
+				for (auto &keyValue : keyValues)
+				{
+					key_p.mv_data = (void*)keyValue.first.data();
+					key_p.mv_size = keyValue.first.size();
+					data_p.mv_data = (void*)keyValue.second.data();
+					data_p.mv_size = keyValue.second.size();
+
+					rc = mdb_put(txn, dbi, &key_p, &data_p, 0);
+
+					if (rc != 0)
+					{
+						mdb_txn_abort(txn);
+						mdb_close(env, dbi);
+						mdb_env_close(env);
+						throw exception(rc == MDB_MAP_FULL
+							? "LmdbClient::Set(): the database is full"
+							: "LmdbClient::Set(): failed to set the value of a key");
+					}
+				}
+
+				rc = mdb_txn_commit(txn);
+
+				if (rc != 0)
+				{
+					mdb_txn_abort(txn);
+					mdb_close(env, dbi);
+					mdb_env_close(env);
+					throw exception("LmdbClient::Set(): failed to commit a transaction");
+				}
+
+				mdb_close(env, dbi);
+				mdb_env_close(env);
+			}
+
+			// removes all keys
+			static
+				void
+				Clear(
+					const string &path)
+			{
+				int rc = 0;
+				MDB_env *env = NULL;
+				MDB_dbi dbi = 0;
+				MDB_txn *txn = NULL;
+
+				rc = mdb_env_create(&env);
+
+				if (rc != 0)
+				{
+					mdb_env_close(env);
+					throw exception("LmdbClient::Clear(): failed to create an environment");
+				}
+
+				rc = mdb_env_open(env, path.c_str(), 0, 0664);
+
+				if (rc != 0)
+				{
+					mdb_env_close(env);
+					throw exception("LmdbClient::Clear(): failed to open an environment");
+				}
+
+				rc = mdb_txn_begin(env, NULL, 0, &txn);
+
+				if (rc != 0)
+				{
+					mdb_txn_abort(txn);
+					mdb_env_close(env);
+					throw exception("LmdbClient::Clear(): failed to begin a transaction");
+				}
+
+				rc = mdb_open(txn, NULL, 0, &dbi);
+
+				if (rc != 0)
+				{
+					mdb_txn_abort(txn);
+					mdb_close(env, dbi);
+					mdb_env_close(env);
+					throw exception("LmdbClient::Clear(): failed to open a database");
+				}
+
+				rc = mdb_drop(txn, dbi, 0);
+
+				if (rc != 0)
+				{
+					mdb_txn_abort(txn);
+					mdb_close(env, dbi);
+					mdb_env_close(env);
+					throw exception("LmdbClient::Clear(): failed to remove keys");
+				}
+
+				rc = mdb_txn_commit(txn);
+
+				if (rc != 0)
+				{
+					mdb_txn_abort(txn);
+					mdb_close(env, dbi);
+					mdb_env_close(env);
+					throw exception("LmdbClient::Clear(): failed to commit a transaction");
+				}
+
+				mdb_close(env, dbi);
+				mdb_env_close(env);
+			}
+
 			static
 				void
 				Remove(
@@ -126,7 +126,7 @@ namespace Integro
 					, const string &database
 					, const string &collection
 					, const string &attribute
-					, vector<int> &values)
+					, vector<long long> &values)
 			{
 				if (attribute == "")
 				{
@@ -162,6 +162,65 @@ namespace Integro
 				}
 			}
 
+			// yields all objects with only the given attributes
+			static
+				void
+				Query(
+					function<void(Mave::Mave&)> OnObject
+					, const string &url
+					, const string &database
+					, const string &collection
+					, const vector<string> &attributes)
+			{
+				bsoncxx::builder::stream::document projection;
+				for (auto &a : attributes)
+				{
+					projection << a << 1;
+				}
+
+				mongocxx::options::find options;
+				options.projection(projection.view());
+
+				mongocxx::client client{ mongocxx::uri{ url } };
+				auto cursor = client[database][collection].find({}, options);
+				for (auto d : cursor)
+				{
+					OnObject(Mave::FromBson(d));
+				}
+			}
+
+			// yields objects whose attribute has the given bson type
+			static
+				void
+				Query(
+					function<void(Mave::Mave&)> OnObject
+					, const string &url
+					, const string &database
+					, const string &collection
+					, const string &attribute
+					, const bsoncxx::type type)
+			{
+				if (attribute == "")
+				{
+					throw exception("MongoClient::Query(): attribute must be provided");
+				}
+
+				bsoncxx::builder::stream::document filter;
+				filter
+					<< attribute
+					<< bsoncxx::builder::stream::open_document
+					<< "$type"
+					<< (int)type
+					<< bsoncxx::builder::stream::close_document;
+
+				mongocxx::client client{ mongocxx::uri{ url } };
+				auto cursor = client[database][collection].find(filter.view());
+				for (auto d : cursor)
+				{
+					OnObject(Mave::FromBson(d));
+				}
+			}
+
 			static
 				void
 				Query(
@@ -323,6 +382,47 @@ namespace Integro
 				}
 			}
 
+			// sets the attributes of every object except _id on the stored document with the same _id
+			static
+				void
+				Update(
+					const vector<Mave::Mave> &objects
+					, const string &url
+					, const string &database
+					, const string &collection)
+			{
+				if (!objects.empty())
+				{
+					mongocxx::options::bulk_write options; options.ordered(false);
+					mongocxx::bulk_write bulk{ options };
+					for (auto &o : objects)
+					{
+						bsoncxx::builder::stream::document filter;
+						if (o["_id"].IsString())
+						{
+							filter << "_id" << o["_id"].AsString();
+						}
+						else if (o["_id"].IsCustom() && o["_id"].AsCustom().first == Mave::BSON_OID)
+						{
+							filter << "_id" << bsoncxx::oid(o["_id"].AsCustom().second);
+						}
+						else
+						{
+							throw exception("MongoClient::Update(): unexpected id type encountered");
+						}
+						Mave::Mave fields = o;
+						fields.AsMap().erase("_id");
+						bsoncxx::builder::stream::document update;
+						update << "$set" << bsoncxx::types::b_document{ ToBsonDocument(fields).view() };
+						mongocxx::model::update_one updateOne{ filter.view(), update.view() };
+						bulk.append(updateOne);
+					}
+
+					mongocxx::client client{ mongocxx::uri{ url } };
+					auto result = client[database][collection].bulk_write(bulk);
+				}
+			}
+
 			static
 				void
 				CreateIndex(
@@ -22,6 +22,7 @@ namespace Integro
 		using std::map;
 		using std::exception;
 		using std::function;
+		using std::move;
 
 		class TdsClient
 		{
@@ -240,7 +241,8 @@ namespace Integro
 				FetchResults(
 					function<void(Mave::Mave&)> OnRow)
 			{
-				vector<string> columns;
+				vector<Mave::Key> columns;
+				vector<BYTE> buffer;
 
 				while (true)
 				{
@@ -263,6 +265,8 @@ namespace Integro
 						continue;
 					}
 
+					columns.clear();
+
 					for (auto i = 0; i < columnCount; ++i)
 					{
 						auto name = dbcolname(dbproc, i + 1);
@@ -278,7 +282,8 @@ namespace Integro
 							break;
 						}
 
-						map<string, Mave::Mave> row;
+						Mave::Map row;
+						row.reserve(columnCount);
 
 						switch (rowCode)
 						{
@@ -295,7 +300,7 @@ namespace Integro
 									{
 										auto type = dbcoltype(dbproc, i + 1);
 										auto length = dbdatlen(dbproc, i + 1);
-										vector<BYTE> buffer(max(32, 2 * length) + 2, 0);
+										buffer.assign(max(32, 2 * length) + 2, 0);
 										auto count = dbconvert(dbproc, type, data, length, SYBCHAR, &buffer[0], buffer.size() - 1);
 
 										if (count == -1)
@@ -306,7 +311,10 @@ namespace Integro
 										row.insert({ columns[i], ToTrimmedString((char*)&buffer[0], (char*)&buffer[count]) });
 									}
 								}
-								OnRow(Mave::Mave(row));
+								{
+									Mave::Mave datum(move(row));
+									OnRow(datum);
+								}
 								break;
 							case BUF_FULL:
 								throw exception("TdsClient::FetchResults(): failed to fetch a row, the buffer is full");
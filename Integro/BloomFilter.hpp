@@ -0,0 +1,286 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cmath>
+#include <cstring>
+#include <exception>
+#include <utility>
+
+#include "Hash.hpp"
+
+namespace Integro
+{
+	using std::string;
+	using std::vector;
+	using std::exception;
+
+	// a scalable bloom filter of 64 bit hashes (Almeida et al.)
+	// items go to the last stage, when it is full a stage with twice the capacity
+	// and half the false positive rate is added, so the total rate stays below twice the first one
+	class BloomFilter
+	{
+		static const unsigned char version = 1;
+
+		struct Stage
+		{
+			unsigned long long capacity;
+			unsigned long long count;
+			unsigned long long bitCount;
+			unsigned int hashCount;
+			vector<unsigned long long> bits;
+		};
+
+		unsigned long long capacity_;
+		double falsePositiveRate_;
+		vector<Stage> stages_;
+
+		static
+			unsigned long long
+			Mix(
+				unsigned long long x)
+		{
+			x ^= x >> 33;
+			x *= 0xFF51AFD7ED558CCDULL;
+			x ^= x >> 33;
+			x *= 0xC4CEB9FE1A85EC53ULL;
+			x ^= x >> 33;
+			return x;
+		}
+
+		void
+			AddStage()
+		{
+			auto index = stages_.size();
+			auto rate = falsePositiveRate_ / (double)(1ULL << index);
+			Stage stage;
+			stage.capacity = capacity_ << index;
+			stage.count = 0;
+			stage.bitCount = (unsigned long long)std::ceil(-(double)stage.capacity * std::log(rate) / (std::log(2.0) * std::log(2.0)));
+			stage.bitCount = (stage.bitCount + 63) / 64 * 64;
+			stage.hashCount = (unsigned int)std::ceil(-std::log(rate) / std::log(2.0));
+			stage.bits.assign((size_t)(stage.bitCount / 64), 0);
+			stages_.push_back(std::move(stage));
+		}
+
+		// double hashing, bit i is h1 + i * h2
+		static
+			bool
+			Test(
+				const Stage &stage
+				, const unsigned long long h1
+				, const unsigned long long h2)
+		{
+			for (unsigned int i = 0; i < stage.hashCount; ++i)
+			{
+				auto bit = (h1 + i * h2) % stage.bitCount;
+				if ((stage.bits[(size_t)(bit / 64)] & (1ULL << (bit % 64))) == 0)
+				{
+					return false;
+				}
+			}
+
+			return true;
+		}
+
+		static
+			void
+			Write(
+				unsigned long long value
+				, string &buffer)
+		{
+			for (int i = 0; i < 8; ++i)
+			{
+				buffer += (char)(value >> (8 * i));
+			}
+		}
+
+		static
+			unsigned long long
+			Read(
+				const char *&p
+				, const char *end)
+		{
+			if (end - p < 8)
+			{
+				throw exception("BloomFilter::Parse(): unexpected end of data");
+			}
+
+			unsigned long long value = 0;
+			for (int i = 0; i < 8; ++i)
+			{
+				value |= (unsigned long long)(unsigned char)p[i] << (8 * i);
+			}
+			p += 8;
+			return value;
+		}
+
+	public:
+		BloomFilter(
+			const unsigned long long capacity = 100000
+			, const double falsePositiveRate = 0.001)
+			: capacity_(capacity)
+			, falsePositiveRate_(falsePositiveRate)
+		{
+			AddStage();
+		}
+
+		void
+			Add(
+				const unsigned long long hash)
+		{
+			if (stages_.back().count == stages_.back().capacity)
+			{
+				AddStage();
+			}
+
+			auto &stage = stages_.back();
+			auto h1 = Mix(hash);
+			auto h2 = Mix(hash ^ 0x9E3779B97F4A7C15ULL) | 1;
+
+			for (unsigned int i = 0; i < stage.hashCount; ++i)
+			{
+				auto bit = (h1 + i * h2) % stage.bitCount;
+				stage.bits[(size_t)(bit / 64)] |= 1ULL << (bit % 64);
+			}
+
+			++stage.count;
+		}
+
+		// false means the hash has never been added, true means it probably has
+		bool
+			MayContain(
+				const unsigned long long hash) const
+		{
+			auto h1 = Mix(hash);
+			auto h2 = Mix(hash ^ 0x9E3779B97F4A7C15ULL) | 1;
+
+			for (auto &stage : stages_)
+			{
+				if (Test(stage, h1, h2))
+				{
+					return true;
+				}
+			}
+
+			return false;
+		}
+
+		// the number of added hashes, including repeated ones
+		unsigned long long
+			Count() const
+		{
+			unsigned long long count = 0;
+
+			for (auto &stage : stages_)
+			{
+				count += stage.count;
+			}
+
+			return count;
+		}
+
+		// 'B' 'F' version, parameters, stages and a crc32c of everything before it
+		string
+			ToString() const
+		{
+			string buffer;
+			buffer += 'B';
+			buffer += 'F';
+			buffer += (char)version;
+
+			double rate = falsePositiveRate_;
+			unsigned long long rateBits;
+			memcpy(&rateBits, &rate, 8);
+
+			Write(capacity_, buffer);
+			Write(rateBits, buffer);
+			Write(stages_.size(), buffer);
+
+			for (auto &stage : stages_)
+			{
+				Write(stage.count, buffer);
+
+				for (auto word : stage.bits)
+				{
+					Write(word, buffer);
+				}
+			}
+
+			Write(Crc32c().Update(buffer).Digest(), buffer);
+			return buffer;
+		}
+
+		static
+			BloomFilter
+			Parse(
+				const string &data)
+		{
+			if (data.size() < 3 + 8 || data[0] != 'B' || data[1] != 'F')
+			{
+				throw exception("BloomFilter::Parse(): invalid data");
+			}
+
+			if ((unsigned char)data[2] != version)
+			{
+				throw exception("BloomFilter::Parse(): unsupported version");
+			}
+
+			auto p = data.data() + data.size() - 8;
+
+			if (Read(p, data.data() + data.size()) != Crc32c().Update(data.data(), data.size() - 8).Digest())
+			{
+				throw exception("BloomFilter::Parse(): checksum mismatch");
+			}
+
+			p = data.data() + 3;
+			auto end = data.data() + data.size() - 8;
+
+			auto capacity = Read(p, end);
+			auto rateBits = Read(p, end);
+			double rate;
+			memcpy(&rate, &rateBits, 8);
+
+			if (capacity == 0 || !(rate > 0 && rate < 1))
+			{
+				throw exception("BloomFilter::Parse(): invalid parameters");
+			}
+
+			BloomFilter filter(capacity, rate);
+			auto stageCount = Read(p, end);
+
+			if (stageCount == 0 || stageCount > 40)
+			{
+				throw exception("BloomFilter::Parse(): invalid stage count");
+			}
+
+			for (unsigned long long i = 0; i < stageCount; ++i)
+			{
+				if (i > 0)
+				{
+					filter.AddStage();
+				}
+
+				auto &stage = filter.stages_.back();
+				stage.count = Read(p, end);
+
+				if ((unsigned long long)(end - p) < stage.bits.size() * 8)
+				{
+					throw exception("BloomFilter::Parse(): unexpected end of data");
+				}
+
+				for (auto &word : stage.bits)
+				{
+					word = Read(p, end);
+				}
+			}
+
+			if (p != end)
+			{
+				throw exception("BloomFilter::Parse(): unexpected data after the last stage");
+			}
+
+			return filter;
+		}
+	};
+}
\ No newline at end of file
@@ -1,16 +1,34 @@
 #pragma once
 
 #include <sstream>
+#include <fstream>
 #include <string>
 #include <chrono>
 #include <regex>
 #include <vector>
+#include <deque>
 #include <set>
+#include <map>
+#include <unordered_map>
+#include <unordered_set>
+#include <memory>
+#include <algorithm>
 #include <atomic>
+#include <mutex>
+#include <thread>
+#include <exception>
+#include <cstdio>
+
+#if defined(_WIN32) || defined(_WIN64)
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
 
 #include <boost/uuid/uuid.hpp>
 #include <boost/uuid/uuid_generators.hpp>
 #include <boost/uuid/uuid_io.hpp>
+#include <boost/filesystem.hpp>
 
 #include "Access/TdsClient.hpp"
 #include "Access/LdapClient.hpp"
@@ -18,6 +36,10 @@
 #include "Access/ElasticClient.hpp"
 #include "Access/LmdbClient.hpp"
 #include "Synchronized.hpp"
+#include "Pipeline.hpp"
+#include "BloomFilter.hpp"
+#include "LruCache.hpp"
+#include "WorkerPool.hpp"
 #include "Milliseconds.hpp"
 
 namespace Integro
@@ -30,10 +52,82 @@ namespace Integro
 
 	class Copy
 	{
+		// the amount of memory after which a loading thread switches to a new arena
+		static const size_t maxArenaSize = 16 * 1024 * 1024;
+		// the number of loaded datums after which a loading thread waits for a saving thread
+		static const size_t maxQueueSize = 10000;
+		// the number of batches that fit into the budget, so a sink of CopyDataToSinks can fall several batches behind before it lags
+		static const size_t batchesPerBudget = 4;
+
 	public:
 
 		// CopyData
 
+		// limits on the data a copy holds between loading and saving, by count and by estimated size,
+		// held amounts include the batch being saved, peaks are kept across copies
+		struct CopyBudget
+		{
+			size_t maxCount;
+			// 0 does not limit the size
+			size_t maxSize;
+			atomic<size_t> heldCount;
+			atomic<size_t> heldSize;
+			atomic<size_t> peakCount;
+			atomic<size_t> peakSize;
+
+			CopyBudget(
+				const size_t maxCount = maxQueueSize
+				, const size_t maxSize = 0)
+				: maxCount(maxCount)
+				, maxSize(maxSize)
+				, heldCount(0)
+				, heldSize(0)
+				, peakCount(0)
+				, peakSize(0)
+			{
+			}
+
+			void
+				Hold(
+					const size_t count
+					, const size_t size)
+			{
+				Raise(peakCount, heldCount += count);
+				Raise(peakSize, heldSize += size);
+			}
+
+			void
+				Release(
+					const size_t count
+					, const size_t size)
+			{
+				heldCount -= count;
+				heldSize -= size;
+			}
+
+			// drops what a failed copy still held
+			void
+				Reset()
+			{
+				heldCount = 0;
+				heldSize = 0;
+			}
+
+		private:
+			static
+				void
+				Raise(
+					atomic<size_t> &peak
+					, const size_t value)
+			{
+				auto current = peak.load();
+
+				while (current < value && !peak.compare_exchange_weak(current, value))
+				{
+				}
+			}
+		};
+
 		template <
 			typename Datum
 			, typename Time>
@@ -44,10 +138,16 @@ namespace Integro
 				, function<void(vector<Datum>&)> SaveData
 				, function<Time()> LoadStartTime
 				, function<void(Time)> SaveStartTime
-				, function<Time(Datum&)> GetTime)
+				, function<Time(Datum&)> GetTime
+				, function<size_t(Datum&)> GetSize = nullptr
+				, shared_ptr<CopyBudget> budget = nullptr)
 		{
 			auto startTime = LoadStartTime();
+			Mave::Arena::Scope arena;
 			vector<Datum> data;
+			// all data is held until it is saved, so the budget only records the peaks
+			auto limits = budget != nullptr ? budget : make_shared<CopyBudget>();
+			limits->Reset();
 
 			LoadData(startTime, [&](Datum &datum)
 			{
@@ -58,6 +158,7 @@ namespace Integro
 					startTime = time;
 				}
 
+				limits->Hold(1, GetSize != nullptr ? GetSize(datum) : 0);
 				data.push_back(datum);
 			});
 
@@ -66,6 +167,8 @@ namespace Integro
 				SaveData(data);
 				SaveStartTime(startTime);
 			}
+
+			limits->Reset();
 		}
 
 		template <
@@ -78,68 +181,68 @@ namespace Integro
 				, function<void(vector<Datum>&)> SaveData
 				, function<Time()> LoadStartTime
 				, function<void(Time)> SaveStartTime
-				, function<Time(Datum&)> GetTime)
+				, function<Time(Datum&)> GetTime
+				, function<size_t(Datum&)> GetSize = nullptr
+				, shared_ptr<CopyBudget> budget = nullptr)
 		{
 			auto startTime = LoadStartTime();
-			SynchronizedBuffer<Datum> buffer;
+			auto limits = budget != nullptr ? budget : make_shared<CopyBudget>();
+			limits->Reset();
+			// closed when either action finishes, so the other one stops waiting
+			BoundedQueue<Datum> queue(limits->maxCount, limits->maxSize);
 			auto hasFailed = false;
 			atomic_flag lock = ATOMIC_FLAG_INIT;
 			string error;
 
-			auto TryThrow = [&]()
-			{
-				if (hasFailed)
-				{
-					throw exception("Copy::CopyDataInChunks(): abortion requested due to errors");
-				}
-			};
-
 			enum ActionName { LoadDataAN, SaveDataAN };
-			bool hasActionFinished[] = { false, false };
 			function<void()> actions[] =
 			{
 				[&]() // LoadData
 				{
+					Mave::Arena::Scope arena;
+
 					LoadData(startTime, [&](Datum &datum)
 					{
-						while (buffer.Size() > 10000)
+						auto size = GetSize != nullptr ? GetSize(datum) : 0;
+						limits->Hold(1, size);
+
+						if (!queue.Push(datum, size))
 						{
-							TryThrow();
-							this_thread::sleep_for(chrono::milliseconds(1));
+							throw exception("Copy::CopyDataInChunks(): abortion requested due to errors");
 						}
 
-						TryThrow();
-						buffer.AddOne(datum);
+						// the retired arena is freed when the save thread drops the data allocated from it
+						if (arena.Size() > maxArenaSize)
+						{
+							arena.Renew();
+						}
 					});
 				},
 
 				[&]() // SaveData
 				{
-					while (!hasActionFinished[LoadDataAN] || !buffer.IsEmpty())
+					vector<Datum> data;
+					size_t dataSize;
+
+					while (queue.PopAll(data, &dataSize))
 					{
-						if (buffer.IsEmpty())
-						{
-							this_thread::sleep_for(chrono::milliseconds(1));
-						}
-						else
+						Mave::Arena::Scope arena;
+
+						for (auto &datum : data)
 						{
-							auto data = buffer.GetAll();
+							auto time = GetTime(datum);
 
-							for (auto &datum : data)
+							if (startTime > time)
 							{
-								auto time = GetTime(datum);
-
-								if (startTime > time)
-								{
-									throw exception("Copy::CopyDataInChunks(): invariant violation, the current record's time must be greater than or equal to the previous record's time");
-								}
-
-								startTime = time;
+								throw exception("Copy::CopyDataInChunks(): invariant violation, the current record's time must be greater than or equal to the previous record's time");
 							}
 
-							SaveData(data);
-							SaveStartTime(startTime);
+							startTime = time;
 						}
+
+						SaveData(data);
+						SaveStartTime(startTime);
+						limits->Release(data.size(), dataSize);
 					}
 				}
 			};
@@ -167,8 +270,7 @@ namespace Integro
 					}
 				}
 
-				atomic_thread_fence(memory_order_seq_cst);
-				hasActionFinished[actionName] = true;
+				queue.Close();
 			};
 
 			thread SaveDataThread(OnError, SaveDataAN);
@@ -197,14 +299,28 @@ namespace Integro
 				, function<void(Time)> SaveStartTime
 				, function<void(Id&)> SaveStartId
 				, function<Time(Datum&)> GetTime
-				, function<Id(Datum&)> GetId)
+				, function<Id(Datum&)> GetId
+				, function<size_t(Datum&)> GetSize = nullptr
+				, shared_ptr<CopyBudget> budget = nullptr)
 		{
 			auto cappedStartId = LoadStartId();
 			auto cappedStartTime = LoadStartTime();
 			auto storeStartId = cappedStartId;
 			auto storeStartTime = cappedStartTime;
-			SynchronizedBuffer<Datum> cappedBuffer;
-			SynchronizedBuffer<Datum> storeBuffer;
+			auto limits = budget != nullptr ? budget : make_shared<CopyBudget>();
+			limits->Reset();
+			// a queue is closed when an action that uses it finishes, or when any action fails,
+			// both queues fill up while the store data catches up, so each gets half of the budget
+			auto maxCount = limits->maxCount / 2 > 0 ? limits->maxCount / 2 : 1;
+			BoundedQueue<Datum> cappedQueue(maxCount, limits->maxSize / 2);
+			BoundedQueue<Datum> storeQueue(maxCount, limits->maxSize / 2);
+
+			auto Push = [&](BoundedQueue<Datum> &queue, Datum &datum)
+			{
+				auto size = GetSize != nullptr ? GetSize(datum) : 0;
+				limits->Hold(1, size);
+				return queue.Push(datum, size);
+			};
 			auto hasLoadingStoreDataBeenRequested = false;
 			auto hasLoadingStoreDataBeenDisabled = false;
 			auto hasFailed = false;
@@ -227,8 +343,7 @@ namespace Integro
 				{
 					LoadCappedData(cappedStartId, [&](Datum &datum)
 					{
-						TryThrow(hasFailed, false);
-						cappedBuffer.AddOne(datum);
+						TryThrow(!Push(cappedQueue, datum), false);
 					});
 				},
 					[&]() // LoadStoreData
@@ -246,14 +361,7 @@ namespace Integro
 
 							LoadData(storeStartTime, [&](Datum &datum)
 							{
-								while (storeBuffer.Size() > 10000)
-								{
-									TryThrow(hasActionFinished[SaveStoreDataAN], false);
-									this_thread::sleep_for(chrono::milliseconds(1));
-								}
-
-								TryThrow(hasActionFinished[SaveStoreDataAN], false);
-								storeBuffer.AddOne(datum);
+								TryThrow(!Push(storeQueue, datum), false);
 							});
 						}
 					}
@@ -261,59 +369,53 @@ namespace Integro
 					[&]() // SaveCappedData
 				{
 					auto hasSavedMetadata = false;
+					vector<Datum> data;
+					size_t dataSize;
 
-					while (!hasActionFinished[LoadCappedDataAN] || !cappedBuffer.IsEmpty())
+					while (cappedQueue.PopAll(data, &dataSize))
 					{
-						if (cappedBuffer.IsEmpty())
+						for (auto &datum : data)
 						{
-							this_thread::sleep_for(chrono::milliseconds(1));
-						}
-						else
-						{
-							auto data = cappedBuffer.GetAll();
+							auto id = GetId(datum);
 
-							for (auto &datum : data)
+							if (!hasLoadingStoreDataBeenDisabled)
 							{
-								auto id = GetId(datum);
-
-								if (!hasLoadingStoreDataBeenDisabled)
+								if (id == cappedStartId)
 								{
-									if (id == cappedStartId)
-									{
-										hasLoadingStoreDataBeenDisabled = true;
-									}
-									else
-									{
-										hasLoadingStoreDataBeenRequested = true;
+									hasLoadingStoreDataBeenDisabled = true;
+								}
+								else
+								{
+									hasLoadingStoreDataBeenRequested = true;
 
-										while (!hasLoadingStoreDataBeenDisabled
-											&& !hasActionFinished[LoadStoreDataAN])
-										{
-											this_thread::sleep_for(chrono::milliseconds(1));
-										}
+									while (!hasLoadingStoreDataBeenDisabled
+										&& !hasActionFinished[LoadStoreDataAN])
+									{
+										this_thread::sleep_for(chrono::milliseconds(1));
 									}
 								}
+							}
 
-								cappedStartId = id;
-
-								auto time = GetTime(datum);
+							cappedStartId = id;
 
-								if (cappedStartTime > time)
-								{
-									throw exception("Copy::CopyCappedDataInChunks(): invariant violation, the current record's time must be greater than or equal to the previous record's time");
-								}
+							auto time = GetTime(datum);
 
-								cappedStartTime = time;
+							if (cappedStartTime > time)
+							{
+								throw exception("Copy::CopyCappedDataInChunks(): invariant violation, the current record's time must be greater than or equal to the previous record's time");
 							}
 
-							SaveData(data);
+							cappedStartTime = time;
+						}
 
-							if (hasActionFinished[SaveStoreDataAN] && !hasFailed)
-							{
-								SaveStartId(cappedStartId);
-								SaveStartTime(cappedStartTime);
-								hasSavedMetadata = true;
-							}
+						SaveData(data);
+						limits->Release(data.size(), dataSize);
+
+						if (hasActionFinished[SaveStoreDataAN] && !hasFailed)
+						{
+							SaveStartId(cappedStartId);
+							SaveStartTime(cappedStartTime);
+							hasSavedMetadata = true;
 						}
 					}
 
@@ -339,35 +441,30 @@ namespace Integro
 				},
 					[&]() // SaveStoreData
 				{
-					while (!hasActionFinished[LoadStoreDataAN] || !storeBuffer.IsEmpty())
+					vector<Datum> data;
+					size_t dataSize;
+
+					while (storeQueue.PopAll(data, &dataSize))
 					{
-						if (storeBuffer.IsEmpty())
-						{
-							this_thread::sleep_for(chrono::milliseconds(1));
-						}
-						else
+						for (auto &datum : data)
 						{
-							auto data = storeBuffer.GetAll();
-
-							for (auto &datum : data)
-							{
-								auto id = GetId(datum);
-								storeStartId = id;
+							auto id = GetId(datum);
+							storeStartId = id;
 
-								auto time = GetTime(datum);
+							auto time = GetTime(datum);
 
-								if (storeStartTime > time)
-								{
-									throw exception("Copy::CopyCappedDataInChunks(): invariant violation, the current record's time must be greater than or equal to the previous record's time");
-								}
-
-								storeStartTime = time;
+							if (storeStartTime > time)
+							{
+								throw exception("Copy::CopyCappedDataInChunks(): invariant violation, the current record's time must be greater than or equal to the previous record's time");
 							}
 
-							SaveData(data);
-							SaveStartId(storeStartId);
-							SaveStartTime(storeStartTime);
+							storeStartTime = time;
 						}
+
+						SaveData(data);
+						SaveStartId(storeStartId);
+						SaveStartTime(storeStartTime);
+						limits->Release(data.size(), dataSize);
 					}
 				}
 			};
@@ -395,6 +492,16 @@ namespace Integro
 					}
 				}
 
+				if (hasFailed || actionName == LoadCappedDataAN || actionName == SaveCappedDataAN)
+				{
+					cappedQueue.Close();
+				}
+
+				if (hasFailed || actionName == LoadStoreDataAN || actionName == SaveStoreDataAN)
+				{
+					storeQueue.Close();
+				}
+
 				atomic_thread_fence(memory_order_seq_cst);
 				hasActionFinished[actionName] = true;
 			};
@@ -411,413 +518,1653 @@ namespace Integro
 			TryThrow(hasFailed, true);
 		}
 
-		// LoadData
-
-		static
-			auto
-			LoadDataTds(
-				const string &host
-				, const string &user
-				, const string &password
-				, const string &database
-				, const string &query)
-		{
-			return [=](milliseconds startTime, function<void(Mave::Mave&)> OnDatum) mutable
-			{
-				// TEMPORARY SOLUTION NOTICE:
-				// subtract 1 second from startTime to compensate for addition of 1 second in a query
-				// must be removed when queries are fixed
-				auto q = regex_replace(query
-					, regex("\\$\\(LAST_EXEC_TIME\\)")
-					, startTime <= milliseconds(1000)
-					? "CONVERT(datetime, '1970-01-01')"
-					: "convert(datetime, '" + Milliseconds::ToUtc(startTime - milliseconds(1000), true) + "')");
-
-				Access::TdsClient::ExecuteQuery(host, user, password, database, q, OnDatum);
-			};
-		}
-
-		static
-			auto
-			LoadDataLdap(
-				const string &host
-				, const int port
-				, const string &user
-				, const string &password
-				, const string &node
-				, const string &filter
-				, const string &idAttribute
-				, const string &timeAttribute
-				, function<void(const string&)> OnError
-				, function<void(const string&)> OnEvent)
+		// a step of CopyDataInStages that runs up to concurrency batches at once,
+		// steps that keep state between batches are expected to run one batch at a time
+		template <
+			typename Datum>
+			struct CopyStage
 		{
-			return [=](milliseconds startTime, function<void(Mave::Mave&)> OnDatum) mutable
+			function<void(vector<Datum>&)> Run;
+			size_t concurrency;
+
+			CopyStage(
+				function<void(vector<Datum>&)> Run
+				, const size_t concurrency = 1)
+				: Run(Run)
+				, concurrency(concurrency)
 			{
-				Access::LdapClient::Search(host, port, user, password, node, filter, idAttribute, timeAttribute, startTime, milliseconds::zero(), OnDatum, OnError, OnEvent);
-			};
-		}
+			}
+		};
 
-		static
-			auto
-			LoadDataMongo(
-				const string &url
-				, const string &database
-				, const string &collection
-				, const string &timeAttribute)
+		// a data store of CopyDataToSinks with its own start time
+		template <
+			typename Datum
+			, typename Time>
+			struct CopySink
 		{
-			Access::MongoClient::CreateIndex(timeAttribute, url, database, collection);
+			function<void(vector<Datum>&)> SaveData;
+			function<Time()> LoadStartTime;
+			function<void(Time)> SaveStartTime;
 
-			return [=](milliseconds startTime, function<void(Mave::Mave&)> OnDatum) mutable
+			CopySink(
+				function<void(vector<Datum>&)> SaveData
+				, function<Time()> LoadStartTime
+				, function<void(Time)> SaveStartTime)
+				: SaveData(SaveData)
+				, LoadStartTime(LoadStartTime)
+				, SaveStartTime(SaveStartTime)
 			{
-				Access::MongoClient::Query(OnDatum, url, database, collection, timeAttribute, startTime, milliseconds::zero());
-			};
-		}
+			}
+		};
 
-		static
-			auto
-			LoadCappedDataMongo(
-				const string &url
-				, const string &database
-				, const string &collection)
+	private:
+		template <
+			typename Datum
+			, typename Time>
+			struct CopyBatch
 		{
-			return [=](bsoncxx::oid &startId, function<void(Mave::Mave&)> OnDatum) mutable
-			{
-				Access::MongoClient::QueryCapped(OnDatum, url, database, collection, startId);
-			};
-		}
+			vector<Datum> data;
+			// the time of the last datum
+			Time time;
+			size_t count;
+			size_t size;
+		};
+
+		// loads data from startTime in batches of at most 1 / batchesPerBudget of the limits and runs the stages on them,
+		// Commit gets the batches in the order they were loaded after all stages have run them,
+		// loaded batches are committed even if loading fails, then the loading exception is thrown
+		template <
+			typename Datum
+			, typename Time>
+			static
+			void
+			LoadDataInStages(
+				function<void(Time, function<void(Datum&)>)> LoadData
+				, const vector<CopyStage<Datum>> &stages
+				, const Time startTime
+				, function<Time(Datum&)> GetTime
+				, function<size_t(Datum&)> GetSize
+				, shared_ptr<CopyBudget> limits
+				, function<void(CopyBatch<Datum, Time>&)> Commit)
+		{
+			typedef CopyBatch<Datum, Time> Batch;
 
-		// SaveData
+			// closed when loading finishes or the pipeline stops
+			BoundedQueue<Datum> queue(limits->maxCount, limits->maxSize);
+			string error;
 
-		static
-			auto
-			SaveDataMongo(
-				const string &url
-				, const string &database
-				, const string &collection)
-		{
-			return [=](vector<Mave::Mave> &data) mutable
-			{
-				Access::MongoClient::Upsert(data, url, database, collection);
-			};
-		}
+			vector<typename Pipeline<Batch>::Stage> pipelineStages;
 
-		static
-			auto
-			SaveDataElastic(
-				const string &url
-				, const string &index
-				, const string &type)
-		{
-			return [=](vector<Mave::Mave> &data) mutable
+			for (auto &stage : stages)
 			{
-				Access::ElasticClient::Index(data, url, index, type);
-			};
-		}
+				auto Run = stage.Run;
 
-		// ProcessData
+				pipelineStages.emplace_back([Run](Batch &batch)
+				{
+					Mave::Arena::Scope arena;
+					Run(batch.data);
+				}, stage.concurrency);
+			}
 
-		static
-			auto
-			ProcessDataTds(
-				const string &channelName
-				, const string &modelName
-				, const string &model
-				, const string &action
-				, const vector<string> &targetStores)
-		{
-			return [=](vector<Mave::Mave> &data) mutable
+			thread LoadDataThread([&]()
 			{
-				for (auto &datum : data)
+				try
 				{
-					datum = map<string, Mave::Mave>(
+					Mave::Arena::Scope arena;
+
+					LoadData(startTime, [&](Datum &datum)
 					{
-						{ "_id", boost::uuids::to_string(boost::uuids::random_generator()()) }
-						,{ "_uid", datum.AsMap().count("_uid") == 0 ? "" : datum["_uid"].AsString() }
-						, { "action", action }
-						, { "channel", channelName }
-						, { "modelName", modelName }
-						, { "processed", 0 }
-						, { "start_time", Milliseconds::FromUtc(datum["start_time"].AsString()) }
-						, { "source", datum }
+						auto size = GetSize != nullptr ? GetSize(datum) : 0;
+						limits->Hold(1, size);
+
+						if (!queue.Push(datum, size))
+						{
+							throw exception("Copy::LoadDataInStages(): abortion requested due to errors");
+						}
+
+						if (arena.Size() > maxArenaSize)
+						{
+							arena.Renew();
+						}
 					});
+				}
+				catch (const exception &ex)
+				{
+					error = ex.what();
+				}
+				catch (...)
+				{
+					error = "ellipsis exception";
+				}
+
+				queue.Close();
+			});
 
-					auto &d = datum.AsMap();
-					auto &s = d["source"].AsMap();
+			try
+			{
+				Pipeline<Batch>(pipelineStages).Run([&](function<bool(Batch&&)> Push)
+				{
+					Batch batch;
+					batch.time = startTime;
 
-					if (s.count("forType") > 0)
-					{
-						d["modelName"] = s["forType"].AsString();
-					}
+					auto maxBatchCount = (std::max)(limits->maxCount / batchesPerBudget, (size_t)1);
+					auto maxBatchSize = limits->maxSize == 0 ? 0 : (std::max)(limits->maxSize / batchesPerBudget, (size_t)1);
 
-					if (targetStores.size() > 0)
+					while (queue.PopAll(batch.data, &batch.size, maxBatchCount, maxBatchSize))
 					{
-						d["targetStores"] = targetStores;
-					}
-				}
-			};
-		}
+						for (auto &datum : batch.data)
+						{
+							auto time = GetTime(datum);
 
-		static
-			auto
-			ProcessDataLdap(
-				const string &idAttribute
-				, const string &channelName
-				, const string &modelName
+							if (batch.time > time)
+							{
+								throw exception("Copy::LoadDataInStages(): invariant violation, the current record's time must be greater than or equal to the previous record's time");
+							}
+
+							batch.time = time;
+						}
+
+						auto time = batch.time;
+						batch.count = batch.data.size();
+
+						if (!Push(move(batch)))
+						{
+							return;
+						}
+
+						batch = Batch();
+						batch.time = time;
+					}
+				}, Commit);
+			}
+			catch (...)
+			{
+				queue.Close();
+				LoadDataThread.join();
+				throw;
+			}
+
+			LoadDataThread.join();
+
+			if (!error.empty())
+			{
+				throw exception(error.c_str());
+			}
+		}
+
+	public:
+		// like CopyDataInChunks, but SaveData is split into stages that run on their own threads,
+		// so a batch is processed by one stage while the next batch is processed by the previous one,
+		// the start time is saved after all stages have run a batch and all earlier batches
+		template <
+			typename Datum
+			, typename Time>
+			static
+			void
+			CopyDataInStages(
+				function<void(Time, function<void(Datum&)>)> LoadData
+				, const vector<CopyStage<Datum>> &stages
+				, function<Time()> LoadStartTime
+				, function<void(Time)> SaveStartTime
+				, function<Time(Datum&)> GetTime
+				, function<size_t(Datum&)> GetSize = nullptr
+				, shared_ptr<CopyBudget> budget = nullptr)
+		{
+			auto limits = budget != nullptr ? budget : make_shared<CopyBudget>();
+			limits->Reset();
+
+			LoadDataInStages<Datum, Time>(LoadData, stages, LoadStartTime(), GetTime, GetSize, limits, [&](CopyBatch<Datum, Time> &batch)
+			{
+				SaveStartTime(batch.time);
+				limits->Release(batch.count, batch.size);
+			});
+		}
+
+		// loads data once from the earliest start time of the sinks, runs the stages on it and hands it to every sink,
+		// each sink saves batches on its own thread, skips batches older than its start time and saves its start time,
+		// a batch is kept in a spool limited by the budget until all sinks have saved it,
+		// a sink that is a full spool behind a sink that has saved all batches is detached, so a slow sink does not slow down the others,
+		// it finishes the batch it is saving, its detachment is thrown at the end and it resumes from its own start time on the next copy,
+		// a sink that fails attemptCount times in a row gives up, the others go on, and its exception is thrown at the end
+		template <
+			typename Datum
+			, typename Time>
+			static
+			void
+			CopyDataToSinks(
+				function<void(Time, function<void(Datum&)>)> LoadData
+				, const vector<CopyStage<Datum>> &stages
+				, const vector<CopySink<Datum, Time>> &sinks
+				, function<Time(Datum&)> GetTime
+				, function<size_t(Datum&)> GetSize = nullptr
+				, shared_ptr<CopyBudget> budget = nullptr
+				, const size_t attemptCount = 3
+				, const milliseconds pauseBetweenAttempts = milliseconds(1000))
+		{
+			typedef CopyBatch<Datum, Time> Batch;
+
+			if (sinks.empty())
+			{
+				throw exception("Copy::CopyDataToSinks(): no sinks");
+			}
+
+			vector<Time> startTimes;
+
+			for (auto &sink : sinks)
+			{
+				startTimes.push_back(sink.LoadStartTime());
+			}
+
+			auto limits = budget != nullptr ? budget : make_shared<CopyBudget>();
+			limits->Reset();
+			ReplayBuffer<shared_ptr<Batch>> spool(sinks.size(), limits->maxCount, limits->maxSize, true);
+			vector<string> errors(sinks.size());
+			vector<thread> threads;
+
+			for (size_t i = 0; i < sinks.size(); ++i)
+			{
+				threads.emplace_back([&, i]()
+				{
+					shared_ptr<Batch> batch;
+
+					while (spool.Read(i, batch))
+					{
+						for (size_t attempt = 1; !(batch->time < startTimes[i]); ++attempt)
+						{
+							try
+							{
+								Mave::Arena::Scope arena;
+								auto data = batch->data;
+								sinks[i].SaveData(data);
+								sinks[i].SaveStartTime(batch->time);
+								break;
+							}
+							catch (const exception &ex)
+							{
+								errors[i] = ex.what();
+							}
+							catch (...)
+							{
+								errors[i] = "ellipsis exception";
+							}
+
+							if (attempt >= attemptCount)
+							{
+								spool.Detach(i);
+								return;
+							}
+
+							this_thread::sleep_for(pauseBetweenAttempts);
+						}
+
+						errors[i].clear();
+						spool.Next(i);
+					}
+
+					if (spool.IsDetached(i))
+					{
+						errors[i] = "Copy::CopyDataToSinks(): sink # " + to_string(i + 1) + " has been detached, it was a full spool behind the others";
+					}
+				});
+			}
+
+			threads.emplace_back([&]()
+			{
+				vector<shared_ptr<Batch>> batches;
+
+				while (spool.PopPassed(batches))
+				{
+					for (auto &batch : batches)
+					{
+						limits->Release(batch->count, batch->size);
+					}
+				}
+			});
+
+			auto loadStartTime = startTimes[0];
+
+			for (auto &startTime : startTimes)
+			{
+				if (startTime < loadStartTime)
+				{
+					loadStartTime = startTime;
+				}
+			}
+
+			exception_ptr loadingError;
+
+			try
+			{
+				LoadDataInStages<Datum, Time>(LoadData, stages, loadStartTime, GetTime, GetSize, limits, [&](Batch &batch)
+				{
+					// sinks that fall behind are detached only while another one is attached
+					if (spool.AttachedCount() == 0)
+					{
+						throw exception("Copy::CopyDataToSinks(): all sinks have failed");
+					}
+
+					auto count = batch.count;
+					auto size = batch.size;
+					spool.Push(make_shared<Batch>(move(batch)), count, size);
+				});
+			}
+			catch (...)
+			{
+				loadingError = current_exception();
+			}
+
+			// sinks save what is left in the spool
+			spool.Close();
+
+			for (auto &t : threads)
+			{
+				t.join();
+			}
+
+			for (auto &error : errors)
+			{
+				if (!error.empty())
+				{
+					throw exception(error.c_str());
+				}
+			}
+
+			if (loadingError != nullptr)
+			{
+				rethrow_exception(loadingError);
+			}
+		}
+
+		// LoadData
+
+		static
+			auto
+			LoadDataTds(
+				const string &host
+				, const string &user
+				, const string &password
+				, const string &database
+				, const string &query)
+		{
+			return [=](milliseconds startTime, function<void(Mave::Mave&)> OnDatum) mutable
+			{
+				// TEMPORARY SOLUTION NOTICE:
+				// subtract 1 second from startTime to compensate for addition of 1 second in a query
+				// must be removed when queries are fixed
+				auto q = regex_replace(query
+					, regex("\\$\\(LAST_EXEC_TIME\\)")
+					, startTime <= milliseconds(1000)
+					? "CONVERT(datetime, '1970-01-01')"
+					: "convert(datetime, '" + Milliseconds::ToUtc(startTime - milliseconds(1000), true) + "')");
+
+				Access::TdsClient::ExecuteQuery(host, user, password, database, q, OnDatum);
+			};
+		}
+
+		static
+			auto
+			LoadDataLdap(
+				const string &host
+				, const int port
+				, const string &user
+				, const string &password
+				, const string &node
+				, const string &filter
+				, const string &idAttribute
+				, const string &timeAttribute
+				, function<void(const string&)> OnError
+				, function<void(const string&)> OnEvent)
+		{
+			return [=](milliseconds startTime, function<void(Mave::Mave&)> OnDatum) mutable
+			{
+				Access::LdapClient::Search(host, port, user, password, node, filter, idAttribute, timeAttribute, startTime, milliseconds::zero(), OnDatum, OnError, OnEvent);
+			};
+		}
+
+		static
+			auto
+			LoadDataMongo(
+				const string &url
+				, const string &database
+				, const string &collection
+				, const string &timeAttribute)
+		{
+			Access::MongoClient::CreateIndex(timeAttribute, url, database, collection);
+
+			return [=](milliseconds startTime, function<void(Mave::Mave&)> OnDatum) mutable
+			{
+				Access::MongoClient::Query(OnDatum, url, database, collection, timeAttribute, startTime, milliseconds::zero());
+			};
+		}
+
+		static
+			auto
+			LoadCappedDataMongo(
+				const string &url
+				, const string &database
+				, const string &collection)
+		{
+			return [=](bsoncxx::oid &startId, function<void(Mave::Mave&)> OnDatum) mutable
+			{
+				Access::MongoClient::QueryCapped(OnDatum, url, database, collection, startId);
+			};
+		}
+
+		// SaveData
+
+		static
+			auto
+			SaveDataMongo(
+				const string &url
+				, const string &database
+				, const string &collection)
+		{
+			return [=](vector<Mave::Mave> &data) mutable
+			{
+				Access::MongoClient::Upsert(data, url, database, collection);
+			};
+		}
+
+		static
+			auto
+			SaveDataElastic(
+				const string &url
+				, const string &index
+				, const string &type)
+		{
+			return [=](vector<Mave::Mave> &data) mutable
+			{
+				Access::ElasticClient::Index(data, url, index, type);
+			};
+		}
+
+		// saves data to all stores at once and returns when all of them are done, expects at least one store,
+		// the first store gets the data and the others get copies that share datums until a store changes them,
+		// rethrows the exception of the first store that failed
+		static
+			auto
+			SaveDataConcurrently(
+				const vector<function<void(vector<Mave::Mave>&)>> &SaveData)
+		{
+			return [=](vector<Mave::Mave> &data) mutable
+			{
+				vector<vector<Mave::Mave>> copies(SaveData.size() - 1, data);
+				vector<exception_ptr> errors(SaveData.size());
+				vector<thread> threads;
+
+				for (size_t i = 1; i < SaveData.size(); ++i)
+				{
+					threads.emplace_back([&, i]()
+					{
+						try
+						{
+							SaveData[i](copies[i - 1]);
+						}
+						catch (...)
+						{
+							errors[i] = current_exception();
+						}
+					});
+				}
+
+				try
+				{
+					SaveData[0](data);
+				}
+				catch (...)
+				{
+					errors[0] = current_exception();
+				}
+
+				for (auto &t : threads)
+				{
+					t.join();
+				}
+
+				for (auto &error : errors)
+				{
+					if (error != nullptr)
+					{
+						rethrow_exception(error);
+					}
+				}
+			};
+		}
+
+		// ProcessData
+
+		static
+			auto
+			ProcessDataTds(
+				const string &channelName
+				, const string &modelName
+				, const string &model
+				, const string &action
+				, const vector<string> &targetStores)
+		{
+			Mave::Key actionValue(action), channelValue(channelName), modelNameValue(modelName);
+			Mave::Mave targetStoresValue(targetStores);
+			// keys are interned once rather than for every datum
+			static const Mave::Key idKey("_id"), uidKey("_uid"), actionKey("action"), channelKey("channel"), modelNameKey("modelName")
+				, processedKey("processed"), startTimeKey("start_time"), sourceKey("source");
+			static const Mave::Key targetStoresKey("targetStores");
+
+			return [=](vector<Mave::Mave> &data) mutable
+			{
+				ParallelFor(data.size(), [&](size_t begin, size_t end)
+				{
+					for (auto i = begin; i < end; ++i)
+					{
+						auto &datum = data[i];
+						const auto &source = datum;
+
+						datum = Mave::Map(
+						{
+							{ idKey, boost::uuids::to_string(boost::uuids::random_generator()()) }
+							,{ uidKey, source.AsMap().count("_uid") == 0 ? "" : source["_uid"].AsString() }
+							, { actionKey, actionValue }
+							, { channelKey, channelValue }
+							, { modelNameKey, modelNameValue }
+							, { processedKey, 0 }
+							, { startTimeKey, Milliseconds::FromUtc(source["start_time"].AsString()) }
+							, { sourceKey, source }
+						});
+
+						auto &d = datum.AsMap();
+						const Mave::Mave &s = d["source"];
+
+						if (s.AsMap().count("forType") > 0)
+						{
+							d[modelNameKey] = s["forType"].AsString();
+						}
+
+						if (targetStores.size() > 0)
+						{
+							d[targetStoresKey] = targetStoresValue;
+						}
+					}
+				});
+			};
+		}
+
+		static
+			auto
+			ProcessDataLdap(
+				const string &idAttribute
+				, const string &channelName
+				, const string &modelName
 				, const string &model
 				, const string &action)
+		{
+			Mave::Key actionValue(action), channelValue(channelName), modelNameValue(modelName);
+			// keys are interned once rather than for every datum
+			static const Mave::Key idKey("_id"), uidKey("_uid"), actionKey("action"), channelKey("channel"), modelNameKey("modelName")
+				, processedKey("processed"), startTimeKey("start_time"), sourceKey("source");
+
+			return [=](vector<Mave::Mave> &data) mutable
+			{
+				for (auto &datum : data)
+				{
+					const auto &source = datum;
+
+					datum = Mave::Map(
+					{
+						{ idKey, source[idAttribute].AsString() }
+						, { uidKey, source[idAttribute].AsString() }
+						, { actionKey, actionValue }
+						, { channelKey, channelValue }
+						, { modelNameKey, modelNameValue }
+						, { processedKey, 0 }
+						, { startTimeKey, duration_cast<milliseconds>(chrono::system_clock::now().time_since_epoch()) }
+						, { sourceKey, source }
+					});
+				}
+			};
+		}
+
+		static
+			auto
+			ProcessDataLdapElastic()
+		{
+			return [=](vector<Mave::Mave> &data) mutable
+			{
+				ParallelFor(data.size(), [&](size_t begin, size_t end)
+				{
+					for (auto i = begin; i < end; ++i)
+					{
+						auto &datum = data[i];
+
+						// Binary
+						{
+							for (auto a :
+							{
+								"msExchMailboxGuid"
+								, "msExchMailboxSecurityDescriptor"
+								, "objectGUID"
+								, "objectSid"
+								, "userParameters"
+								, "userCertificate"
+								, "msExchArchiveGUID"
+								, "msExchBlockedSendersHash"
+								, "msExchSafeSendersHash"
+								, "securityProtocol"
+								, "terminalServer"
+								, "mSMQDigests"
+								, "mSMQSignCertificates"
+								, "msExchSafeRecipientsHash"
+								, "msExchDisabledArchiveGUID"
+								, "sIDHistory"
+								, "replicationSignature"
+								, "msExchMasterAccountSid"
+								, "logonHours"
+								, "thumbnailPhoto"
+							})
+							{
+								auto &s = datum["source"].AsMap();
+
+								if (s.count(a) > 0)
+								{
+									auto &o = s[a];
+
+									if (!o.IsVector())
+									{
+										o = "";
+									}
+									else
+									{
+										for (auto &value : o.AsVector())
+										{
+											value = "";
+										}
+									}
+								}
+							}
+						}
+
+						// Variant
+						{
+							for (auto a :
+							{
+								"extensionAttribute1"
+								, "extensionAttribute2"
+								, "extensionAttribute3"
+								, "extensionAttribute4"
+								, "extensionAttribute5"
+								, "extensionAttribute6"
+								, "extensionAttribute7"
+								, "extensionAttribute8"
+								, "extensionAttribute9"
+								, "extensionAttribute10"
+								, "extensionAttribute11"
+								, "extensionAttribute12"
+								, "extensionAttribute13"
+								, "extensionAttribute14"
+								, "extensionAttribute15"
+							})
+							{
+								auto &s = datum["source"].AsMap();
+
+								if (s.count(a) > 0)
+								{
+									auto &o = s[a];
+
+									if (!o.IsVector())
+									{
+										o = "[string] " + o.AsString();
+									}
+									else
+									{
+										for (auto &value : o.AsVector())
+										{
+											value = "[string] " + value.AsString();
+										}
+									}
+								}
+							}
+						}
+					}
+				});
+			};
+		}
+
+		static
+			auto
+			ProcessDataMongo(
+				const string &channelName
+				, const string &modelName
+				, const string &model
+				, const string &action)
+		{
+			Mave::Key actionValue(action), channelValue(channelName), modelNameValue(modelName);
+			// keys are interned once rather than for every datum
+			static const Mave::Key idKey("_id"), uidKey("_uid"), actionKey("action"), channelKey("channel"), modelNameKey("modelName")
+				, processedKey("processed"), startTimeKey("start_time"), sourceKey("source");
+
+			return [=](vector<Mave::Mave> &data) mutable
+			{
+				for (auto &datum : data)
+				{
+					const auto &source = datum;
+
+					datum = Mave::Map(
+					{
+						{ idKey, boost::uuids::to_string(boost::uuids::random_generator()()) }
+						, { uidKey, source.AsMap().count("_uid") == 0 ? "" : source["_uid"].AsString() }
+						, { actionKey, actionValue }
+						, { channelKey, channelValue }
+						, { modelNameKey, modelNameValue }
+						, { processedKey, 0 }
+						, { startTimeKey, source["start_time"].AsString() }
+						, { sourceKey, source }
+					});
+				}
+			};
+		}
+
+		// Metadata
+
+		// the start time of previousKey is used until one is saved for key, so a new key starts where an old one stopped
+		static
+			auto
+			LoadStartTimeLmdb(
+				const string &path
+				, const string &key
+				, const string &previousKey = "")
+		{
+			return [=]() mutable
+			{
+				auto value = Access::LmdbClient::GetOrDefault(path, key);
+
+				if (value == "" && previousKey != "")
+				{
+					value = Access::LmdbClient::GetOrDefault(path, previousKey);
+				}
+
+				return milliseconds(stoull("0" + value));
+			};
+		}
+
+		static
+			auto
+			LoadStartIdLmdb(
+				const string &path
+				, const string &key)
+		{
+			return [=]() mutable
+			{
+				auto value = Access::LmdbClient::GetOrDefault(path, key);
+				return value == "" ? bsoncxx::types::b_oid().value : bsoncxx::oid(value);
+			};
+		}
+
+		static
+			auto
+			SaveStartTimeLmdb(
+				const string &path
+				, const string &key)
+		{
+			return [=](milliseconds time) mutable
+			{
+				Access::LmdbClient::Set(path, key, to_string(time.count()));
+			};
+		}
+
+		static
+			auto
+			SaveStartIdLmdb(
+				const string &path
+				, const string &key)
+		{
+			return [=](bsoncxx::oid &id) mutable
+			{
+				Access::LmdbClient::Set(path, key, id.to_string());
+			};
+		}
+
+		// Checkpoints
+
+		// start times and ids of several topics that are written to an lmdb database together,
+		// they are written in one transaction after maxPendingCount updates or maxPendingTime after the first one,
+		// copies record them after their data is saved, so writing them late only means copying some data again after a crash
+		class CheckpointManager
+		{
+			string path_;
+			size_t maxPendingCount_;
+			milliseconds maxPendingTime_;
+			mutex lock_;
+			map<string, string> pending_;
+			size_t pendingCount_;
+			steady_clock::time_point firstPendingTime_;
+
+			void
+				Write()
+			{
+				if (pending_.empty())
+				{
+					return;
+				}
+
+				// kept pending if writing fails, so the next update or flush tries again
+				Access::LmdbClient::Set(path_, vector<pair<string, string>>(pending_.begin(), pending_.end()));
+				pending_.clear();
+				pendingCount_ = 0;
+			}
+
+		public:
+			CheckpointManager(
+				const string &path
+				, const size_t maxPendingCount = 100
+				, const milliseconds maxPendingTime = milliseconds(5000))
+				: path_(path)
+				, maxPendingCount_(maxPendingCount)
+				, maxPendingTime_(maxPendingTime)
+				, pendingCount_(0)
+			{
+			}
+
+			// a pending value or the written one, an empty string if there is none
+			string
+				Get(
+					const string &key)
+			{
+				unique_lock<mutex> guard(lock_);
+				auto value = pending_.find(key);
+				return value != pending_.end() ? value->second : Access::LmdbClient::GetOrDefault(path_, key);
+			}
+
+			void
+				Set(
+					const string &key
+					, const string &value)
+			{
+				unique_lock<mutex> guard(lock_);
+
+				if (pending_.empty())
+				{
+					firstPendingTime_ = steady_clock::now();
+				}
+
+				pending_[key] = value;
+				++pendingCount_;
+
+				if (pendingCount_ >= maxPendingCount_ || steady_clock::now() - firstPendingTime_ >= maxPendingTime_)
+				{
+					Write();
+				}
+			}
+
+			// writes pending values now, expected to be called when copies pause or stop
+			void
+				Flush()
+			{
+				unique_lock<mutex> guard(lock_);
+				Write();
+			}
+
+			milliseconds
+				MaxPendingTime() const
+			{
+				return maxPendingTime_;
+			}
+		};
+
+		static
+			auto
+			LoadStartTimeCheckpoint(
+				shared_ptr<CheckpointManager> checkpoints
+				, const string &key
+				, const string &previousKey = "")
+		{
+			return [=]() mutable
+			{
+				auto value = checkpoints->Get(key);
+
+				if (value == "" && previousKey != "")
+				{
+					value = checkpoints->Get(previousKey);
+				}
+
+				return milliseconds(stoull("0" + value));
+			};
+		}
+
+		static
+			auto
+			LoadStartIdCheckpoint(
+				shared_ptr<CheckpointManager> checkpoints
+				, const string &key)
+		{
+			return [=]() mutable
+			{
+				auto value = checkpoints->Get(key);
+				return value == "" ? bsoncxx::types::b_oid().value : bsoncxx::oid(value);
+			};
+		}
+
+		static
+			auto
+			SaveStartTimeCheckpoint(
+				shared_ptr<CheckpointManager> checkpoints
+				, const string &key)
+		{
+			return [=](milliseconds time) mutable
+			{
+				checkpoints->Set(key, to_string(time.count()));
+			};
+		}
+
+		static
+			auto
+			SaveStartIdCheckpoint(
+				shared_ptr<CheckpointManager> checkpoints
+				, const string &key)
+		{
+			return [=](bsoncxx::oid &id) mutable
+			{
+				checkpoints->Set(key, id.to_string());
+			};
+		}
+
+		static
+			auto
+			GetTimeTds(
+				const string &timeAttribute)
+		{
+			return [=](const Mave::Mave &datum) mutable
+			{
+				return Milliseconds::FromUtc(datum[timeAttribute].AsString());
+			};
+		}
+
+		static
+			auto
+			GetTimeLdap(
+				const string &timeAttribute)
+		{
+			return [=](Mave::Mave &datum) mutable
+			{
+				//return ConversionMilliseconds::FromLdapTime(datum[timeAttribute].AsString());
+				//return max(milliseconds::zero(), ConversionMilliseconds::FromLdapTime(datum[timeAttribute].AsString()) - milliseconds(25 * 60 * 60 * 1000));
+				return milliseconds::zero();
+			};
+		}
+
+		static
+			auto
+			GetTimeMongo(
+				const string &timeAttribute)
+		{
+			return [=](const Mave::Mave &datum) mutable
+			{
+				return datum[timeAttribute].AsMilliseconds();
+			};
+		}
+
+		static
+			auto
+			GetIdMongo(
+				const string &idAttribute)
+		{
+			return [=](const Mave::Mave &datum) mutable
+			{
+				return bsoncxx::oid(datum[idAttribute].AsCustom().second);
+			};
+		}
+
+		// Coalescing
+
+		// removes datums whose attribute's value equals the value of another datum in the same data,
+		// the first or the last of them is kept, kept datums and datums without the attribute keep their order
+		static
+			auto
+			CoalesceData(
+				const string &attribute
+				, const bool keepLast)
 		{
 			return [=](vector<Mave::Mave> &data) mutable
 			{
-				for (auto &datum : data)
+				if (data.size() < 2)
+				{
+					return;
+				}
+
+				// values by hash, values are compared only when hashes are equal
+				unordered_multimap<long long, size_t> values;
+				vector<bool> isKept(data.size(), false);
+				size_t keptCount = 0;
+
+				for (size_t n = 0; n < data.size(); ++n)
 				{
-					datum = map<string, Mave::Mave>(
+					auto i = keepLast ? data.size() - 1 - n : n;
+					const Mave::Mave &datum = data[i];
+
+					if (datum.AsMap().count(attribute) != 0)
 					{
-						{ "_id", datum[idAttribute].AsString() }
-						, { "_uid", datum[idAttribute].AsString() }
-						, { "action", action }
-						, { "channel", channelName }
-						, { "modelName", modelName }
-						, { "processed", 0 }
-						, { "start_time", duration_cast<milliseconds>(chrono::system_clock::now().time_since_epoch()) }
-						, { "source", datum }
-					});
+						const auto &value = datum[attribute];
+						auto hash = HashLong(value);
+						auto same = values.equal_range(hash);
+
+						if (any_of(same.first, same.second, [&](const pair<const long long, size_t> &v) { return Equal(((const Mave::Mave&)data[v.second])[attribute], value); }))
+						{
+							continue;
+						}
+
+						values.insert({ hash, i });
+					}
+
+					isKept[i] = true;
+					++keptCount;
+				}
+
+				if (keptCount == data.size())
+				{
+					return;
+				}
+
+				vector<Mave::Mave> coalescedData;
+				coalescedData.reserve(keptCount);
+
+				for (size_t i = 0; i < data.size(); ++i)
+				{
+					if (isKept[i])
+					{
+						coalescedData.push_back(move(data[i]));
+					}
 				}
+
+				data = move(coalescedData);
 			};
 		}
 
+		// Duplicates
+
+		// returns the descriptor of a datum, a long descriptor it already has, such as one added by RemoveDuplicatesCached,
+		// is taken as it is, otherwise the source is hashed and the descriptor is added, so only such datums are detached
+		static
+			long long
+			AddDescriptor(
+				Mave::Mave &datum
+				, const Mave::Key &descriptorKey
+				, const string &sourceAttribute)
+		{
+			const auto &map = ((const Mave::Mave&)datum).AsMap();
+			auto current = map.find(descriptorKey);
+
+			if (current != map.end() && current->second.IsLong())
+			{
+				return current->second.AsLong();
+			}
+
+			auto descriptor = HashLong(((const Mave::Mave&)datum)[sourceAttribute]);
+			datum.AsMap().insert({ descriptorKey, descriptor });
+
+			return descriptor;
+		}
+
 		static
 			auto
-			ProcessDataLdapElastic()
+			RemoveDuplicates(
+				const string &descriptorAttribute
+				, const string &sourceAttribute
+				, function<void(const string&, vector<long long>&, function<void(Mave::Mave&)>)> LoadData)
 		{
+			// interned once rather than by every worker for every datum
+			Mave::Key descriptorKey(descriptorAttribute);
+
 			return [=](vector<Mave::Mave> &data) mutable
 			{
-				for (auto &datum : data)
+				if (data.size() == 0)
 				{
-					// Binary
+					return;
+				}
+
+				vector<long long> descriptors(data.size());
+
+				ParallelFor(data.size(), [&](size_t begin, size_t end)
+				{
+					for (auto i = begin; i < end; ++i)
 					{
-						for (auto a :
-						{
-							"msExchMailboxGuid"
-							, "msExchMailboxSecurityDescriptor"
-							, "objectGUID"
-							, "objectSid"
-							, "userParameters"
-							, "userCertificate"
-							, "msExchArchiveGUID"
-							, "msExchBlockedSendersHash"
-							, "msExchSafeSendersHash"
-							, "securityProtocol"
-							, "terminalServer"
-							, "mSMQDigests"
-							, "mSMQSignCertificates"
-							, "msExchSafeRecipientsHash"
-							, "msExchDisabledArchiveGUID"
-							, "sIDHistory"
-							, "replicationSignature"
-							, "msExchMasterAccountSid"
-							, "logonHours"
-							, "thumbnailPhoto"
-						})
-						{
-							auto &s = datum["source"].AsMap();
+						descriptors[i] = AddDescriptor(data[i], descriptorKey, sourceAttribute);
+					}
+				});
 
-							if (s.count(a) > 0)
-							{
-								auto &o = s[a];
+				// stored sources by descriptor, sources are compared only when descriptors are equal
+				unordered_multimap<long long, Mave::Mave> storedSources;
 
-								if (!o.IsVector())
-								{
-									o = "";
-								}
-								else
-								{
-									for (auto &i : o.AsVector())
-									{
-										i = "";
-									}
-								}
-							}
-						}
+				LoadData(descriptorAttribute, descriptors, [&](Mave::Mave &datum)
+				{
+					auto &descriptor = datum[descriptorAttribute];
+
+					// mongo matches numbers across types, so legacy int descriptors can come back and are skipped,
+					// elastic returns longs as strings
+					if (descriptor.IsLong() || descriptor.IsString())
+					{
+						storedSources.insert({ descriptor.IsLong() ? descriptor.AsLong() : stoll(descriptor.AsString()), datum[sourceAttribute] });
 					}
+				});
 
-					// Variant
+				if (storedSources.size() == 0)
+				{
+					return;
+				}
+
+				vector<Mave::Mave> noDuplicatesData;
+
+				for (size_t i = 0; i < data.size(); ++i)
+				{
+					const auto &source = ((const Mave::Mave&)data[i])[sourceAttribute];
+					auto stored = storedSources.equal_range(descriptors[i]);
+
+					if (none_of(stored.first, stored.second, [&](const pair<const long long, Mave::Mave> &s) { return Equal(s.second, source); }))
 					{
-						for (auto a :
-						{
-							"extensionAttribute1"
-							, "extensionAttribute2"
-							, "extensionAttribute3"
-							, "extensionAttribute4"
-							, "extensionAttribute5"
-							, "extensionAttribute6"
-							, "extensionAttribute7"
-							, "extensionAttribute8"
-							, "extensionAttribute9"
-							, "extensionAttribute10"
-							, "extensionAttribute11"
-							, "extensionAttribute12"
-							, "extensionAttribute13"
-							, "extensionAttribute14"
-							, "extensionAttribute15"
-						})
-						{
-							auto &s = datum["source"].AsMap();
+						noDuplicatesData.push_back(move(data[i]));
+					}
+				}
 
-							if (s.count(a) > 0)
-							{
-								auto &o = s[a];
+				data = move(noDuplicatesData);
+			};
+		}
 
-								if (!o.IsVector())
-								{
-									o = "[string] " + o.AsString();
-								}
-								else
-								{
-									for (auto &i : o.AsVector())
-									{
-										i = "[string] " + i.AsString();
-									}
-								}
-							}
-						}
+		// Duplicate cache
+
+		// sources recently saved to one collection by descriptor
+		struct DuplicateCache
+		{
+			// descriptors and digests of sources
+			typedef vector<pair<long long, Digest128>> Sources;
+
+			LruCache<long long, Digest128> sources;
+
+			DuplicateCache(
+				const size_t capacity)
+				: sources(capacity)
+			{
+			}
+		};
+
+		// removes datums whose sources are in the cache before RemoveDuplicates looks them up,
+		// tds queries read an overlap window again on every run, so recent rows are usually cache hits,
+		// the remaining datums get their descriptors, so RemoveDuplicates does not hash their sources again,
+		// returns the sources of the remaining data, which are expected to be passed to SaveDuplicateCache after the data is saved
+		static
+			auto
+			RemoveDuplicatesCached(
+				const string &descriptorAttribute
+				, const string &sourceAttribute
+				, shared_ptr<DuplicateCache> cache
+				, function<void(vector<Mave::Mave>&)> RemoveDuplicates)
+		{
+			Mave::Key descriptorKey(descriptorAttribute);
+
+			return [=](vector<Mave::Mave> &data) mutable
+			{
+				DuplicateCache::Sources kept;
+
+				if (data.size() == 0)
+				{
+					return kept;
+				}
+
+				DuplicateCache::Sources sources(data.size());
+
+				ParallelFor(data.size(), [&](size_t begin, size_t end)
+				{
+					for (auto i = begin; i < end; ++i)
+					{
+						const auto &source = ((const Mave::Mave&)data[i])[sourceAttribute];
+						sources[i] = { HashLong(source), HashWide(source) };
+					}
+				});
+
+				vector<Mave::Mave> misses;
+				// shallow copies of the sources of misses, which are shared with the misses
+				vector<Mave::Mave> missSourceValues;
+				DuplicateCache::Sources missSources;
+
+				for (size_t i = 0; i < data.size(); ++i)
+				{
+					if (!cache->sources.Contains(sources[i].first, sources[i].second))
+					{
+						data[i].AsMap().insert({ descriptorKey, sources[i].first });
+						misses.push_back(data[i]);
+						missSourceValues.push_back(((const Mave::Mave&)data[i])[sourceAttribute]);
+						missSources.push_back(sources[i]);
+					}
+				}
+
+				RemoveDuplicates(misses);
+
+				// the remaining misses keep their order, so they are paired with their sources in one pass,
+				// misses that were removed in between were found in the store and are cached right away
+				size_t j = 0;
+
+				for (auto &datum : misses)
+				{
+					const auto &source = ((const Mave::Mave&)datum)[sourceAttribute];
+
+					for (; j < missSourceValues.size() && !Mave::Equal(source, missSourceValues[j]); ++j)
+					{
+						cache->sources.Put(missSources[j].first, missSources[j].second);
+					}
+
+					if (j == missSourceValues.size())
+					{
+						throw exception("Copy::RemoveDuplicatesCached(): invariant violation, RemoveDuplicates must keep the order and sources of data");
+					}
+
+					kept.push_back(missSources[j++]);
+				}
+
+				for (; j < missSources.size(); ++j)
+				{
+					cache->sources.Put(missSources[j].first, missSources[j].second);
+				}
+
+				data = move(misses);
+				return kept;
+			};
+		}
+
+		// caches the sources returned by RemoveDuplicatesCached, expected to be called after their data is saved
+		static
+			auto
+			SaveDuplicateCache(
+				shared_ptr<DuplicateCache> cache)
+		{
+			return [=](const DuplicateCache::Sources &sources) mutable
+			{
+				for (auto &source : sources)
+				{
+					cache->sources.Put(source.first, source.second);
+				}
+			};
+		}
+
+		// Change detection
+
+		// ids and fingerprints of filtered batches that are not stored yet, one entry per batch in the order of the batches,
+		// so filtering and storing can run on different threads, expected to be cleared before a copy starts
+		struct PendingFingerprints
+		{
+			mutex lock;
+			deque<vector<pair<string, string>>> batches;
+
+			void
+				Clear()
+			{
+				unique_lock<mutex> guard(lock);
+				batches.clear();
+			}
+		};
+
+		// removes datums whose source has the same fingerprint as when a datum with the same id was saved last,
+		// fingerprints of the remaining datums wait in pending until SaveFingerprintsLmdb is called
+		static
+			auto
+			RemoveUnchangedLmdb(
+				const string &idAttribute
+				, const string &sourceAttribute
+				, const string &path
+				, function<Digest128(const Mave::Mave&)> Fingerprint
+				, shared_ptr<PendingFingerprints> pending)
+		{
+			return [=](vector<Mave::Mave> &data) mutable
+			{
+				vector<pair<string, string>> changed;
+
+				if (data.size() == 0)
+				{
+					unique_lock<mutex> guard(pending->lock);
+					pending->batches.push_back(move(changed));
+					return;
+				}
+
+				vector<string> ids(data.size());
+				vector<string> fingerprints(data.size());
+
+				ParallelFor(data.size(), [&](size_t begin, size_t end)
+				{
+					for (auto i = begin; i < end; ++i)
+					{
+						const Mave::Mave &datum = data[i];
+						const auto &id = datum[idAttribute];
+						ids[i] = id.IsString() ? id.AsString() : ToString(id);
+						fingerprints[i] = DigestBytes(Fingerprint(datum[sourceAttribute]));
+					}
+				});
+
+				unordered_map<string, string> storedFingerprints;
+
+				Access::LmdbClient::Get(path, ids, [&](const string &id, const string &fingerprint)
+				{
+					storedFingerprints[id] = fingerprint;
+				});
+
+				vector<Mave::Mave> changedData;
+
+				for (size_t i = 0; i < data.size(); ++i)
+				{
+					auto stored = storedFingerprints.find(ids[i]);
+
+					if (stored == storedFingerprints.end() || stored->second != fingerprints[i])
+					{
+						changedData.push_back(move(data[i]));
+						changed.push_back({ ids[i], fingerprints[i] });
 					}
 				}
+
+				data = move(changedData);
+
+				unique_lock<mutex> guard(pending->lock);
+				pending->batches.push_back(move(changed));
 			};
 		}
 
+		// stores the fingerprints of the earliest filtered batch, expected to be called after the batch is saved to all stores
 		static
 			auto
-			ProcessDataMongo(
-				const string &channelName
-				, const string &modelName
-				, const string &model
-				, const string &action)
+			SaveFingerprintsLmdb(
+				const string &path
+				, shared_ptr<PendingFingerprints> pending)
 		{
-			return [=](vector<Mave::Mave> &data) mutable
+			return [=]() mutable
 			{
-				for (auto &datum : data)
+				vector<pair<string, string>> fingerprints;
+
 				{
-					datum = map<string, Mave::Mave>(
+					unique_lock<mutex> guard(pending->lock);
+
+					if (pending->batches.empty())
 					{
-						{ "_id", boost::uuids::to_string(boost::uuids::random_generator()()) }
-						, { "_uid", datum.AsMap().count("_uid") == 0 ? "" : datum["_uid"].AsString() }
-						, { "action", action }
-						, { "channel", channelName }
-						, { "modelName", modelName }
-						, { "processed", 0 }
-						, { "start_time", datum["start_time"].AsString() }
-						, { "source", datum }
-					});
+						return;
+					}
+
+					fingerprints = move(pending->batches.front());
+					pending->batches.pop_front();
+				}
+
+				if (!fingerprints.empty())
+				{
+					Access::LmdbClient::Set(path, fingerprints, duplicateIndexMapSize);
 				}
 			};
 		}
 
-		// Metadata
+		// Bloom filter
 
+		// writes data to a file and makes it durable before returning, the file is replaced or appended to
 		static
-			auto
-			LoadStartTimeLmdb(
+			void
+			WriteFileDurably(
 				const string &path
-				, const string &key)
+				, const string &data
+				, const bool isAppending)
 		{
-			return [=]() mutable
+			auto file = fopen(path.c_str(), isAppending ? "ab" : "wb");
+
+			if (file == nullptr)
 			{
-				return milliseconds(stoull("0" + Access::LmdbClient::GetOrDefault(path, key)));
-			};
+				throw exception(("Copy::WriteFileDurably(): failed to open '" + path + "'").c_str());
+			}
+
+			auto isWritten = fwrite(data.data(), 1, data.size(), file) == data.size() && fflush(file) == 0;
+#if defined(_WIN32) || defined(_WIN64)
+			isWritten = isWritten && _commit(_fileno(file)) == 0;
+#else
+			isWritten = isWritten && fsync(fileno(file)) == 0;
+#endif
+			isWritten = fclose(file) == 0 && isWritten;
+
+			if (!isWritten)
+			{
+				throw exception(("Copy::WriteFileDurably(): failed to write '" + path + "'").c_str());
+			}
 		}
 
+		// a scalable bloom filter of descriptors saved to a store, kept in a file and a journal of descriptors added since the file was written,
+		// descriptors are journaled before data is saved, so a failed save or a crash only costs false positives,
+		// the filter is written again once the journal holds journalLimit descriptors
 		static
 			auto
-			LoadStartIdLmdb(
+			LoadDuplicateDataBloom(
 				const string &path
-				, const string &key)
+				, function<void(const string&, vector<long long>&, function<void(Mave::Mave&)>)> LoadData
+				, function<void(function<void(long long)>)> LoadDescriptors
+				, const size_t journalLimit = 100000)
 		{
-			return [=]() mutable
+			// shared by copies of the returned function, so the filter is read once
+			struct State
 			{
-				auto value = Access::LmdbClient::GetOrDefault(path, key);
-				return value == "" ? bsoncxx::types::b_oid().value : bsoncxx::oid(value);
+				shared_ptr<BloomFilter> filter;
+				size_t journalCount;
 			};
-		}
 
-		static
-			auto
-			SaveStartTimeLmdb(
-				const string &path
-				, const string &key)
-		{
-			return [=](milliseconds time) mutable
+			auto state = make_shared<State>();
+			state->journalCount = 0;
+			auto journalPath = path + ".journal";
+
+			// descriptors are journaled as 8 bytes little endian
+			auto ToJournal = [](const vector<long long> &values)
 			{
-				Access::LmdbClient::Set(path, key, to_string(time.count()));
+				string data(8 * values.size(), '\0');
+
+				for (size_t i = 0; i < values.size(); ++i)
+				{
+					for (size_t j = 0; j < 8; ++j)
+					{
+						data[8 * i + j] = (char)((unsigned long long)values[i] >> (8 * j));
+					}
+				}
+
+				return data;
 			};
-		}
 
-		static
-			auto
-			SaveStartIdLmdb(
-				const string &path
-				, const string &key)
-		{
-			return [=](bsoncxx::oid &id) mutable
+			auto Save = [=](const BloomFilter &filter)
 			{
-				Access::LmdbClient::Set(path, key, id.to_string());
+				auto temporaryPath = path + ".tmp";
+				WriteFileDurably(temporaryPath, filter.ToString(), false);
+				boost::filesystem::rename(temporaryPath, path);
+				// a crash before the journal is cleared only replays descriptors the filter already has
+				WriteFileDurably(journalPath, "", false);
+				state->journalCount = 0;
+			};
+
+			auto Load = [=]()
+			{
+				std::ifstream input(path, std::ios::binary);
+
+				if (input)
+				{
+					stringstream buffer;
+					buffer << input.rdbuf();
+
+					try
+					{
+						state->filter = make_shared<BloomFilter>(BloomFilter::Parse(buffer.str()));
+					}
+					catch (const exception&)
+					{
+						// a damaged filter is rebuilt below
+					}
+				}
+
+				if (state->filter == nullptr)
+				{
+					// the store has every saved descriptor, so the journal is not needed
+					state->filter = make_shared<BloomFilter>();
+					LoadDescriptors([&](long long descriptor)
+					{
+						state->filter->Add((unsigned long long)descriptor);
+					});
+					Save(*state->filter);
+					return;
+				}
+
+				std::ifstream journal(journalPath, std::ios::binary);
+				stringstream journalBuffer;
+				journalBuffer << journal.rdbuf();
+				auto data = journalBuffer.str();
+
+				// a descriptor cut short by a crash was not followed by a save
+				for (size_t i = 0; i + 8 <= data.size(); i += 8)
+				{
+					unsigned long long descriptor = 0;
+
+					for (size_t j = 0; j < 8; ++j)
+					{
+						descriptor |= (unsigned long long)(unsigned char)data[i + j] << (8 * j);
+					}
+
+					state->filter->Add(descriptor);
+					++state->journalCount;
+				}
+
+				if (data.size() % 8 != 0)
+				{
+					Save(*state->filter);
+				}
+			};
+
+			return [=](const string &attribute, vector<long long> &values, function<void(Mave::Mave&)> OnDatum) mutable
+			{
+				if (state->filter == nullptr)
+				{
+					Load();
+				}
+
+				auto &filter = *state->filter;
+				vector<long long> candidates;
+
+				for (auto value : values)
+				{
+					if (filter.MayContain((unsigned long long)value))
+					{
+						candidates.push_back(value);
+					}
+				}
+
+				for (auto value : values)
+				{
+					filter.Add((unsigned long long)value);
+				}
+
+				WriteFileDurably(journalPath, ToJournal(values), true);
+				state->journalCount += values.size();
+
+				if (state->journalCount >= journalLimit)
+				{
+					Save(filter);
+				}
+
+				if (!candidates.empty())
+				{
+					LoadData(attribute, candidates, OnDatum);
+				}
 			};
 		}
 
 		static
 			auto
-			GetTimeTds(
-				const string &timeAttribute)
+			LoadDescriptorsMongo(
+				const string &url
+				, const string &database
+				, const string &collection
+				, const string &descriptorAttribute)
 		{
-			return [=](Mave::Mave &datum) mutable
+			return [=](function<void(long long)> OnDescriptor) mutable
 			{
-				return Milliseconds::FromUtc(datum[timeAttribute].AsString());
+				Access::MongoClient::Query([&](Mave::Mave &datum)
+				{
+					const auto &document = datum;
+
+					if (document.AsMap().count(descriptorAttribute) == 0)
+					{
+						return;
+					}
+
+					auto &descriptor = document[descriptorAttribute];
+
+					if (descriptor.IsLong() || descriptor.IsString())
+					{
+						OnDescriptor(descriptor.IsLong() ? descriptor.AsLong() : stoll(descriptor.AsString()));
+					}
+				}, url, database, collection, vector<string>({ descriptorAttribute }));
 			};
 		}
 
+		// Duplicate index
+
+		// a local lmdb index of saved sources, keys are HashWide of sources and values are ids,
+		// the state key tells whether the index covers everything in the store:
+		//	""			never built, duplicates are looked up remotely
+		//	"ready"		complete, duplicates are looked up locally
+		//	"dirty"		a batch is being saved and may be missing, duplicates are looked up remotely
+		//				and the stored matches are added to the index until the next save completes
+		static const size_t duplicateIndexMapSize = 512 * 1024 * 1024;
+		static const size_t duplicateIndexBatchSize = 10000;
+
 		static
-			auto
-			GetTimeLdap(
-				const string &timeAttribute)
+			string
+			DuplicateIndexStateKey()
 		{
-			return [=](Mave::Mave &datum) mutable
-			{
-				//return ConversionMilliseconds::FromLdapTime(datum[timeAttribute].AsString());
-				//return max(milliseconds::zero(), ConversionMilliseconds::FromLdapTime(datum[timeAttribute].AsString()) - milliseconds(25 * 60 * 60 * 1000));
-				return milliseconds::zero();
-			};
+			return "state";
 		}
 
+		// 16 little endian bytes
 		static
-			auto
-			GetTimeMongo(
-				const string &timeAttribute)
+			string
+			DigestBytes(
+				const Digest128 &digest)
 		{
-			return [=](Mave::Mave &datum) mutable
+			string bytes(16, '\0');
+
+			for (int i = 0; i < 8; ++i)
 			{
-				return datum[timeAttribute].AsMilliseconds();
-			};
+				bytes[i] = (char)(digest.low >> (8 * i));
+				bytes[8 + i] = (char)(digest.high >> (8 * i));
+			}
+
+			return bytes;
 		}
 
 		static
-			auto
-			GetIdMongo(
-				const string &idAttribute)
+			string
+			DuplicateIndexKey(
+				const Mave::Mave &source)
 		{
-			return [=](Mave::Mave &datum) mutable
-			{
-				return bsoncxx::oid(datum[idAttribute].AsCustom().second);
-			};
+			return DigestBytes(Mave::HashWide(source));
 		}
 
-		// Duplicates
+		static
+			string
+			DuplicateIndexValue(
+				const Mave::Mave &id)
+		{
+			return id.IsString() ? id.AsString() : ToString(id);
+		}
 
+		// like RemoveDuplicates, but decides locally while the index is ready
 		static
 			auto
-			RemoveDuplicates(
+			RemoveDuplicatesLmdb(
 				const string &descriptorAttribute
 				, const string &sourceAttribute
-				, function<void(const string&, vector<int>&, function<void(Mave::Mave&)>)> LoadData)
+				, const string &idAttribute
+				, const string &path
+				, function<void(const string&, vector<long long>&, function<void(Mave::Mave&)>)> LoadData)
 		{
+			Mave::Key descriptorKey(descriptorAttribute);
+			auto found = make_shared<vector<pair<string, string>>>();
+			auto RemoveDuplicatesRemotely = RemoveDuplicates(descriptorAttribute, sourceAttribute
+				, [=](const string &attribute, vector<long long> &values, function<void(Mave::Mave&)> OnDatum) mutable
+			{
+				LoadData(attribute, values, [&](Mave::Mave &datum)
+				{
+					found->push_back({ DuplicateIndexKey(datum[sourceAttribute]), DuplicateIndexValue(datum[idAttribute]) });
+					OnDatum(datum);
+				});
+			});
+
 			return [=](vector<Mave::Mave> &data) mutable
 			{
 				if (data.size() == 0)
@@ -825,44 +2172,116 @@ namespace Integro
 					return;
 				}
 
-				vector<int> descriptors;
+				if (Access::LmdbClient::GetOrDefault(path, DuplicateIndexStateKey()) != "ready")
+				{
+					found->clear();
+					RemoveDuplicatesRemotely(data);
+
+					if (!found->empty())
+					{
+						Access::LmdbClient::Set(path, *found, duplicateIndexMapSize);
+					}
+
+					return;
+				}
+
+				vector<string> keys;
 
 				for (auto &datum : data)
 				{
-					auto descriptor = Hash(datum[sourceAttribute]);
-					datum.AsMap().insert({ descriptorAttribute, descriptor });
-					descriptors.push_back(descriptor);
+					AddDescriptor(datum, descriptorKey, sourceAttribute);
+					keys.push_back(DuplicateIndexKey(((const Mave::Mave&)datum)[sourceAttribute]));
 				}
 
-				set<int> storedDescriptors;
-				set<string> storedSources;
+				unordered_set<string> storedKeys;
 
-				LoadData(descriptorAttribute, descriptors, [&](Mave::Mave &datum)
+				Access::LmdbClient::Get(path, keys, [&](const string &key, const string&)
 				{
-					storedSources.insert(ToString(datum[sourceAttribute]));
-					storedDescriptors.insert(datum[descriptorAttribute].AsInt());
+					storedKeys.insert(key);
 				});
 
-				if (storedDescriptors.size() == 0)
-				{
-					return;
-				}
-
 				vector<Mave::Mave> noDuplicatesData;
 
-				for (auto &datum : data)
+				for (size_t i = 0; i < data.size(); ++i)
 				{
-					if (storedDescriptors.count(datum[descriptorAttribute].AsInt()) == 0
-						|| storedSources.count(ToString(datum[sourceAttribute])) == 0)
+					if (storedKeys.count(keys[i]) == 0)
 					{
-						noDuplicatesData.push_back(datum);
+						noDuplicatesData.push_back(move(data[i]));
 					}
 				}
 
 				data = move(noDuplicatesData);
+				Access::LmdbClient::Set(path, DuplicateIndexStateKey(), "dirty");
+			};
+		}
+
+		// adds saved data to the index, expected to be called right after data is saved
+		static
+			auto
+			SaveDuplicateIndexLmdb(
+				const string &sourceAttribute
+				, const string &idAttribute
+				, const string &path)
+		{
+			return [=](vector<Mave::Mave> &data) mutable
+			{
+				vector<pair<string, string>> keyValues;
+
+				for (auto &datum : data)
+				{
+					keyValues.push_back({ DuplicateIndexKey(datum[sourceAttribute]), DuplicateIndexValue(datum[idAttribute]) });
+				}
+
+				if (Access::LmdbClient::GetOrDefault(path, DuplicateIndexStateKey()) == "dirty")
+				{
+					keyValues.push_back({ DuplicateIndexStateKey(), "ready" });
+				}
+
+				if (!keyValues.empty())
+				{
+					Access::LmdbClient::Set(path, keyValues, duplicateIndexMapSize);
+				}
 			};
 		}
 
+		// rebuilds the index from all documents of a collection, copying to the collection must be stopped meanwhile,
+		// the index stays cold if rebuilding fails
+		static
+			void
+			RebuildDuplicateIndexMongo(
+				const string &url
+				, const string &database
+				, const string &collection
+				, const string &sourceAttribute
+				, const string &idAttribute
+				, const string &path)
+		{
+			Access::LmdbClient::Clear(path);
+
+			vector<pair<string, string>> keyValues;
+
+			Access::MongoClient::Query([&](Mave::Mave &datum)
+			{
+				const auto &document = datum;
+
+				if (document.AsMap().count(sourceAttribute) == 0)
+				{
+					return;
+				}
+
+				keyValues.push_back({ DuplicateIndexKey(document[sourceAttribute]), DuplicateIndexValue(document[idAttribute]) });
+
+				if (keyValues.size() == duplicateIndexBatchSize)
+				{
+					Access::LmdbClient::Set(path, keyValues, duplicateIndexMapSize);
+					keyValues.clear();
+				}
+			}, url, database, collection);
+
+			keyValues.push_back({ DuplicateIndexStateKey(), "ready" });
+			Access::LmdbClient::Set(path, keyValues, duplicateIndexMapSize);
+		}
+
 		static
 			auto
 			LoadDuplicateDataMongo(
@@ -873,12 +2292,71 @@ namespace Integro
 		{
 			Access::MongoClient::CreateIndex(descriptorAttribute, url, database, collection);
 
-			return [=](const string &attribute, vector<int> &values, function<void(Mave::Mave&)> OnDatum) mutable
+			return [=](const string &attribute, vector<long long> &values, function<void(Mave::Mave&)> OnDatum) mutable
 			{
 				Access::MongoClient::Query(OnDatum, url, database, collection, attribute, values);
 			};
 		}
 
+		// version 1 descriptors are 32 bit hashes of ToString stored as ints,
+		// version 2 descriptors are HashLong stored as longs
+		static const int descriptorVersion = 2;
+		static const size_t descriptorMigrationBatchSize = 1000;
+
+		// rewrites int descriptors of a collection once and records the version,
+		// an interrupted migration continues from the documents that still have int descriptors,
+		// the version is kept by the checkpoint manager of the start times, so the metadata database is opened under one lock
+		static
+			auto
+			MigrateDescriptorsMongo(
+				const string &url
+				, const string &database
+				, const string &collection
+				, const string &descriptorAttribute
+				, const string &sourceAttribute
+				, shared_ptr<CheckpointManager> checkpoints
+				, const string &key)
+		{
+			bool isMigrated = false;
+
+			return [=]() mutable
+			{
+				if (isMigrated)
+				{
+					return;
+				}
+
+				if (stoi("0" + checkpoints->Get(key)) < descriptorVersion)
+				{
+					vector<Mave::Mave> updates;
+
+					auto Flush = [&]()
+					{
+						Access::MongoClient::Update(updates, url, database, collection);
+						updates.clear();
+					};
+
+					Access::MongoClient::Query([&](Mave::Mave &datum)
+					{
+						updates.push_back(Mave::Mave(map<string, Mave::Mave>({
+							{ "_id", datum["_id"] }
+							, { descriptorAttribute, HashLong(datum[sourceAttribute]) } })));
+
+						if (updates.size() == descriptorMigrationBatchSize)
+						{
+							Flush();
+						}
+					}, url, database, collection, descriptorAttribute, bsoncxx::type::k_int32);
+
+					Flush();
+					checkpoints->Set(key, to_string(descriptorVersion));
+					checkpoints->Flush();
+				}
+
+				isMigrated = true;
+			};
+		}
+
 		static
 			auto
 			LoadDuplicateDataElastic(
@@ -886,7 +2364,7 @@ namespace Integro
 				, const string &index
 				, const string &type)
 		{
-			return [=](const string &attribute, vector<int> &values, function<void(Mave::Mave&)> OnDatum) mutable
+			return [=](const string &attribute, vector<long long> &values, function<void(Mave::Mave&)> OnDatum) mutable
 			{
 				vector<string> vv; for (auto v : values) vv.push_back(to_string(v));
 				Access::ElasticClient::Search(OnDatum, url, index, type, attribute, vv);
@@ -4,6 +4,25 @@
 #include <fstream>
 
 #include "Integro.hpp"
+#include "Mave/Binary.hpp"
+
+#ifdef INTEGRO_COUNT_ALLOCATIONS
+// counts heap allocations of the whole program, used by performance tests
+std::atomic<long long> allocationCount(0);
+
+void* operator new(size_t size)
+{
+	++allocationCount;
+	auto p = malloc(size == 0 ? 1 : size);
+	if (p == nullptr) throw std::bad_alloc();
+	return p;
+}
+
+void operator delete(void *p) noexcept
+{
+	free(p);
+}
+#endif
 
 namespace Integro
 {
@@ -117,6 +136,25 @@ namespace Integro
 			return r;
 		}
 
+		long long AllocationCount()
+		{
+#ifdef INTEGRO_COUNT_ALLOCATIONS
+			return allocationCount;
+#else
+			return 0;
+#endif
+		}
+
+		void PrintPerformance(const string &s, const steady_clock::time_point start, const long long allocations, const int n)
+		{
+			auto time = duration_cast<microseconds>(steady_clock::now() - start).count();
+			stringstream a; a
+				<< s << ": " << time / 1000 << " ms, "
+				<< (double)time / n << " us per item, "
+				<< (double)(AllocationCount() - allocations) / n << " allocations per item";
+			Print(a.str());
+		}
+
 		void TryThrow(const int n, const string &s)
 		{
 			if (Rand() % (100 * n) == 0)
@@ -303,6 +341,7 @@ namespace Integro
 			auto ProcessData = Copy::ProcessDataTds(channelName, modelName, model, topicName, targetStores);
 			auto LoadDuplicateData = Copy::LoadDuplicateDataMongo(mongoUrl, mongoDatabase, mongoCollection, descriptorAttribute);
 			auto RemoveDuplicates = Copy::RemoveDuplicates(descriptorAttribute, sourceAttribute, LoadDuplicateData);
+			auto MigrateDescriptors = Copy::MigrateDescriptorsMongo(mongoUrl, mongoDatabase, mongoCollection, descriptorAttribute, sourceAttribute, make_shared<Copy::CheckpointManager>(metadataPath), startTimeKey + ".descriptorVersion");
 			auto SaveDataMongo = Copy::SaveDataMongo(mongoUrl, mongoDatabase, mongoCollection);
 			auto SaveDataElastic = Copy::SaveDataElastic(elasticUrl, elasticIndex, elasticType);
 			auto SaveData = [=](vector<Mave::Mave> &data) mutable
@@ -317,6 +356,7 @@ namespace Integro
 			auto GetTime = Copy::GetTimeTds(timeAttribute);
 			auto CopyData = [=]() mutable
 			{
+				MigrateDescriptors();
 				Copy::CopyDataInBulk<Mave::Mave, milliseconds>(LoadData, SaveData, LoadStartTime, SaveStartTime, GetTime);
 			};
 
@@ -331,7 +371,7 @@ namespace Integro
 			int startTime = 0;
 			vector<Mave::Mave> source;
 			map<int, Mave::Mave> dest;
-			multimap<int, Mave::Mave> index;
+			multimap<long long, Mave::Mave> index;
 
 			for (int i = 0, t = 0; i < 100000; ++i)
 			{
@@ -361,7 +401,7 @@ namespace Integro
 			};
 
 			auto RemoveDuplicates = Copy::RemoveDuplicates(descriptorAttribute, sourceAttribute
-				, [&](const string &attribute, vector<int> &values, function<void(Mave::Mave&)> OnDatum)
+				, [&](const string &attribute, vector<long long> &values, function<void(Mave::Mave&)> OnDatum)
 			{
 				TryThrow(1, "failed to remove duplicates");
 
@@ -391,7 +431,7 @@ namespace Integro
 				{
 					TryThrow(100, "failed to save data");
 					dest.insert({ datum[idAttribute].AsInt(), datum });
-					index.insert({ datum[descriptorAttribute].AsInt(), datum });
+					index.insert({ datum[descriptorAttribute].AsLong(), datum });
 					//Print("saved datum: " + ToString(datum));
 				}
 			};
@@ -931,6 +971,45 @@ namespace Integro
 			//cout << bsoncxx::to_json(b4.view()) << endl;
 		}
 
+		// bson transcoded to json must read the same as bson converted to a mave and then to json,
+		// the json is parsed back because transcoding keeps the bson order of fields
+		void BsonJsonTest()
+		{
+			auto document = bsoncxx::builder::stream::document{}
+				<< "_id" << bsoncxx::oid()
+				<< "S" << "with \"quotes\" and \x01"
+				<< "#" << 1
+				<< "L" << (int64_t)(1LL << 40)
+				<< "D" << .1
+				<< "B" << true
+				<< "N" << bsoncxx::types::b_null{}
+				<< "T" << bsoncxx::types::b_date(1500000000123)
+				<< "V" << bsoncxx::builder::stream::open_array << "Monday" << 2 << bsoncxx::builder::stream::close_array
+				<< "M" << bsoncxx::builder::stream::open_document << "z" << "Wednesday" << "a" << 3 << bsoncxx::builder::stream::close_document
+				<< bsoncxx::builder::stream::finalize;
+
+			string transcoded;
+			string converted;
+			Mave::ToJson(document.view(), transcoded);
+			Mave::ToJson(Mave::FromBson(document.view()), converted);
+
+			string transcodedError;
+			string convertedError;
+			auto transcodedJson = Json::parse(transcoded, transcodedError);
+			auto convertedJson = Json::parse(converted, convertedError);
+
+			if (transcodedError == "" && convertedError == "" && transcodedJson == convertedJson)
+			{
+				cout << "BsonJsonTest(): succeeded" << endl;
+			}
+			else
+			{
+				cout << "BsonJsonTest(): failed" << endl;
+				cout << transcoded << endl;
+				cout << converted << endl;
+			}
+		}
+
 		void MaveTest()
 		{
 			Mave::Mave m1 = map<string, Mave::Mave>(
@@ -957,6 +1036,492 @@ namespace Integro
 			cout << ToString(m1) << endl;
 			cout << "-----------------------------------" << endl;
 			cout << ToString(m2) << endl;
+
+			// the same ldap entry with reordered values and another uSNChanged
+			Mave::Mave e1 = map<string, Mave::Mave>({ { "cn", "user" }, { "memberOf", vector<Mave::Mave>({ "a", "b" }) }, { "uSNChanged", "1" } });
+			Mave::Mave e2 = map<string, Mave::Mave>({ { "cn", "user" }, { "memberOf", vector<Mave::Mave>({ "b", "a" }) }, { "uSNChanged", "2" } });
+			set<string> ignoredAttributes({ "uSNChanged" });
+
+			cout << "-----------------------------------" << endl;
+			cout << "fingerprints are "
+				<< (Mave::Fingerprint(e1, ignoredAttributes, set<string>(), true) == Mave::Fingerprint(e2, ignoredAttributes, set<string>(), true) ? "equal" : "different")
+				<< ", hashes are "
+				<< (Mave::HashLong(e1) == Mave::HashLong(e2) ? "equal" : "different") << endl;
+			cout << "estimated sizes are " << Mave::EstimateSize(e1) << " and " << Mave::EstimateSize(e2) << " bytes" << endl;
+		}
+
+		void MavePerformanceTest()
+		{
+			int rowCount = 100000;
+			int columnCount = 40;
+			vector<string> columns;
+			vector<Mave::Mave> rows;
+
+			for (int i = 0; i < columnCount; ++i)
+			{
+				columns.push_back("column_" + to_string(i));
+			}
+
+			cout << "sizeof(Mave): " << sizeof(Mave::Mave) << endl;
+
+			// tds rows, all values are converted to strings
+			{
+				auto start = steady_clock::now();
+				auto allocations = AllocationCount();
+
+				for (int r = 0; r < rowCount; ++r)
+				{
+					map<string, Mave::Mave> row;
+
+					for (int i = 0; i < columnCount; ++i)
+					{
+						row.insert({ columns[i], i % 10 == 0 ? string(100, 'a' + i % 26) : to_string(r * i) });
+					}
+
+					rows.emplace_back(move(row));
+				}
+
+				PrintPerformance("tds rows", start, allocations, rowCount);
+			}
+
+			// scalar rows
+			{
+				auto start = steady_clock::now();
+				auto allocations = AllocationCount();
+
+				for (int r = 0; r < rowCount; ++r)
+				{
+					map<string, Mave::Mave> row;
+
+					for (int i = 0; i < columnCount; ++i)
+					{
+						switch (i % 4)
+						{
+							case 0: row.insert({ columns[i], r }); break;
+							case 1: row.insert({ columns[i], (long long)r * i }); break;
+							case 2: row.insert({ columns[i], r / 3.0 }); break;
+							default: row.insert({ columns[i], milliseconds(r) }); break;
+						}
+					}
+
+					Mave::Mave datum(move(row));
+				}
+
+				PrintPerformance("scalar rows", start, allocations, rowCount);
+			}
+
+			{
+				auto start = steady_clock::now();
+				auto allocations = AllocationCount();
+
+				for (auto &row : rows)
+				{
+					auto copy = Mave::Copy(row);
+				}
+
+				PrintPerformance("Copy", start, allocations, rowCount);
+			}
+
+			{
+				auto start = steady_clock::now();
+				auto allocations = AllocationCount();
+
+				for (auto &row : rows)
+				{
+					auto descriptor = Mave::Hash(row);
+				}
+
+				PrintPerformance("Hash", start, allocations, rowCount);
+			}
+
+			{
+				auto start = steady_clock::now();
+				auto allocations = AllocationCount();
+
+				for (auto &row : rows)
+				{
+					auto descriptor = Mave::HashLong(row);
+				}
+
+				PrintPerformance("HashLong", start, allocations, rowCount);
+			}
+
+			{
+				auto document = ToBsonDocument(rows[0]);
+				auto start = steady_clock::now();
+				auto allocations = AllocationCount();
+
+				for (int r = 0; r < rowCount; ++r)
+				{
+					auto mave = Mave::FromBson(document.view());
+				}
+
+				PrintPerformance("FromBson", start, allocations, rowCount);
+			}
+
+			{
+				auto start = steady_clock::now();
+				auto allocations = AllocationCount();
+
+				for (auto &row : rows)
+				{
+					auto document = ToBsonDocument(row);
+				}
+
+				PrintPerformance("ToBsonDocument", start, allocations, rowCount);
+			}
+
+			{
+				auto start = steady_clock::now();
+				auto allocations = AllocationCount();
+
+				for (auto &row : rows)
+				{
+					auto text = ToJson(row).dump();
+				}
+
+				PrintPerformance("ToJson dump", start, allocations, rowCount);
+			}
+
+			{
+				string buffer;
+				auto start = steady_clock::now();
+				auto allocations = AllocationCount();
+
+				for (auto &row : rows)
+				{
+					buffer.clear();
+					ToJson(row, buffer);
+				}
+
+				PrintPerformance("ToJson buffer", start, allocations, rowCount);
+			}
+
+			{
+				string buffer;
+				auto start = steady_clock::now();
+				auto allocations = AllocationCount();
+
+				for (auto &row : rows)
+				{
+					buffer.clear();
+					Mave::ToBinary(row, buffer);
+				}
+
+				PrintPerformance("ToBinary", start, allocations, rowCount);
+			}
+
+			{
+				auto binary = Mave::ToBinary(rows[0]);
+				auto start = steady_clock::now();
+				auto allocations = AllocationCount();
+
+				for (int r = 0; r < rowCount; ++r)
+				{
+					auto mave = Mave::FromBinary(binary);
+				}
+
+				PrintPerformance("FromBinary", start, allocations, rowCount);
+			}
+		}
+
+		// throughput of the hashes for inputs from 16 B to 1 MB, each case hashes about 256 MB
+		void HashPerformanceTest()
+		{
+			string data;
+			unsigned long long sink = 0;
+
+			for (int i = 0; i < 1024 * 1024; ++i)
+			{
+				data += (char)Rand();
+			}
+
+			auto Measure = [&](const string &name, const size_t size, function<unsigned long long(const char*, size_t)> hash)
+			{
+				auto count = 256 * 1024 * 1024 / size;
+				auto start = steady_clock::now();
+
+				for (size_t i = 0; i < count; ++i)
+				{
+					sink += hash(data.data() + i % 64, size);
+				}
+
+				auto time = duration_cast<microseconds>(steady_clock::now() - start).count();
+				stringstream a; a
+					<< name << " " << size << " B: "
+					<< (double)count * size / (time + 1) << " MB/s";
+				Print(a.str());
+			};
+
+			for (size_t size = 16; size <= 1024 * 1024; size *= 4)
+			{
+				// inputs start at varying offsets within the first 64 bytes of data
+				auto length = size < 64 * 1024 ? size : size - 64;
+
+				Measure("Hash", length, [](const char *p, size_t n) { return (unsigned long long)Hash((const unsigned char*)p, (int)n); });
+				Measure("HashLong", length, [](const char *p, size_t n) { return HashLong(p, n); });
+				Measure("Crc32c", length, [](const char *p, size_t n) { return (unsigned long long)Crc32c().Update(p, n).Digest(); });
+
+				for (auto kernel : { HASH_PORTABLE, HASH_SSE2, HASH_AVX2 })
+				{
+					if (Hash128::UseKernel(kernel))
+					{
+						Measure("HashWide " + string(kernel == HASH_AVX2 ? "avx2" : kernel == HASH_SSE2 ? "sse2" : "portable"), length
+							, [](const char *p, size_t n) { return HashWide(p, n).low; });
+					}
+				}
+			}
+
+			Print("checksum: " + to_string(sink));
+		}
+
+		// compares per datum stages on the calling thread and on the shared worker pool
+		void ParallelForTest()
+		{
+			int rowCount = 100000;
+			int columnCount = 40;
+			vector<Mave::Mave> rows;
+
+			for (int r = 0; r < rowCount; ++r)
+			{
+				map<string, Mave::Mave> row;
+
+				for (int i = 0; i < columnCount; ++i)
+				{
+					row.insert({ "column_" + to_string(i), i % 10 == 0 ? string(100, 'a' + i % 26) : to_string(r * i) });
+				}
+
+				row.insert({ "start_time", "2017-01-01 00:00:00" });
+				rows.emplace_back(move(row));
+			}
+
+			Print("worker threads: ", (int)WorkerPool::Shared().Size());
+
+			vector<long long> sequential(rows.size()), parallel(rows.size());
+
+			{
+				auto start = steady_clock::now();
+				auto allocations = AllocationCount();
+
+				for (size_t i = 0; i < rows.size(); ++i)
+				{
+					sequential[i] = HashLong(rows[i]);
+				}
+
+				PrintPerformance("HashLong sequential", start, allocations, rowCount);
+			}
+
+			{
+				auto start = steady_clock::now();
+				auto allocations = AllocationCount();
+
+				ParallelFor(rows.size(), [&](size_t begin, size_t end)
+				{
+					for (auto i = begin; i < end; ++i)
+					{
+						parallel[i] = HashLong(rows[i]);
+					}
+				});
+
+				PrintPerformance("HashLong parallel", start, allocations, rowCount);
+			}
+
+			Print(sequential == parallel ? "HashLong results are equal" : "HashLong results are different");
+
+			{
+				auto ProcessData = Copy::ProcessDataTds("channel", "modelName", "model", "action", vector<string>());
+				auto data = rows;
+				auto start = steady_clock::now();
+				auto allocations = AllocationCount();
+
+				ProcessData(data);
+
+				PrintPerformance("ProcessDataTds", start, allocations, rowCount);
+
+				auto isOrdered = true;
+
+				for (size_t i = 0; i < data.size(); ++i)
+				{
+					isOrdered = isOrdered && HashLong(((const Mave::Mave&)data[i])["source"]) == sequential[i];
+				}
+
+				Print(isOrdered ? "ProcessDataTds keeps the order" : "ProcessDataTds changes the order");
+			}
+
+			auto thrown = false;
+
+			try
+			{
+				ParallelFor(rows.size(), [&](size_t begin, size_t end)
+				{
+					if (end == rows.size())
+					{
+						throw exception("Debug::ParallelForTest(): expected exception");
+					}
+				});
+			}
+			catch (const exception&)
+			{
+				thrown = true;
+			}
+
+			Print(thrown ? "exceptions are rethrown" : "exceptions are lost");
+		}
+
+		// three steps of 1 ms per batch of 100 datums, run serially in SaveData and as stages
+		void CopyStagesTest()
+		{
+			auto datumCount = 100000;
+			auto LoadData = [&](int startTime, function<void(int&)> OnDatum)
+			{
+				for (auto i = startTime; i < datumCount; ++i)
+				{
+					OnDatum(i);
+				}
+			};
+			auto Step = [](vector<int> &data)
+			{
+				for (size_t i = 0; i < data.size(); i += 100)
+				{
+					this_thread::sleep_for(chrono::milliseconds(1));
+				}
+			};
+			auto LoadStartTime = []() { return 0; };
+			auto GetTime = [](int &datum) { return datum; };
+			auto savedTime = -1;
+			auto isOrdered = true;
+			auto SaveStartTime = [&](int time)
+			{
+				isOrdered = isOrdered && time > savedTime;
+				savedTime = time;
+			};
+
+			{
+				auto start = steady_clock::now();
+				Copy::CopyDataInChunks<int, int>(LoadData, [&](vector<int> &data) { Step(data); Step(data); Step(data); }, LoadStartTime, SaveStartTime, GetTime);
+				Print("serial steps, ms: ", (int)duration_cast<milliseconds>(steady_clock::now() - start).count());
+			}
+
+			savedTime = -1;
+
+			{
+				auto lastDatum = -1;
+				auto areDatumsOrdered = true;
+				auto start = steady_clock::now();
+				Copy::CopyDataInStages<int, int>(LoadData,
+				{
+					{ Step, 2 }
+					, { Step }
+					, { [&](vector<int> &data)
+						{
+							for (auto datum : data)
+							{
+								areDatumsOrdered = areDatumsOrdered && datum == lastDatum + 1;
+								lastDatum = datum;
+							}
+
+							Step(data);
+						} }
+				}, LoadStartTime, SaveStartTime, GetTime);
+				Print("staged steps, ms: ", (int)duration_cast<milliseconds>(steady_clock::now() - start).count());
+				isOrdered = isOrdered && areDatumsOrdered && lastDatum == datumCount - 1;
+			}
+
+			Print(isOrdered && savedTime == datumCount - 1 ? "stages keep the order" : "stages change the order");
+		}
+
+		void CheckpointTest()
+		{
+			auto topicCount = 20;
+			auto updateCount = 50;
+			string path = "test";
+
+			{
+				auto start = steady_clock::now();
+
+				for (auto i = 1; i <= updateCount; ++i)
+				{
+					for (auto topic = 0; topic < topicCount; ++topic)
+					{
+						Copy::SaveStartTimeLmdb(path, "topic" + to_string(topic))(milliseconds(i));
+					}
+				}
+
+				Print("a transaction per update, ms: ", (int)duration_cast<milliseconds>(steady_clock::now() - start).count());
+			}
+
+			{
+				auto checkpoints = make_shared<Copy::CheckpointManager>(path, topicCount);
+				auto start = steady_clock::now();
+
+				for (auto i = 1; i <= updateCount; ++i)
+				{
+					for (auto topic = 0; topic < topicCount; ++topic)
+					{
+						Copy::SaveStartTimeCheckpoint(checkpoints, "topic" + to_string(topic))(milliseconds(updateCount + i));
+					}
+				}
+
+				checkpoints->Flush();
+				Print("a transaction per round of topics, ms: ", (int)duration_cast<milliseconds>(steady_clock::now() - start).count());
+			}
+
+			auto isWritten = true;
+
+			for (auto topic = 0; topic < topicCount; ++topic)
+			{
+				isWritten = isWritten && Copy::LoadStartTimeLmdb(path, "topic" + to_string(topic))() == milliseconds(2 * updateCount);
+			}
+
+			Print(isWritten ? "checkpoints are written" : "checkpoints are lost");
+		}
+
+		void SchedulerTest()
+		{
+			Scheduler scheduler(4);
+			scheduler.SetLimit("slow", 2);
+			mutex lock;
+			auto slowRunningCount = 0;
+			auto slowPeakCount = 0;
+			auto slowRunCount = 0;
+			auto fastRunCount = 0;
+
+			for (auto i = 0; i < 4; ++i)
+			{
+				scheduler.Add("slow", milliseconds(0), [&]()
+				{
+					{
+						unique_lock<mutex> guard(lock);
+						slowPeakCount = max(slowPeakCount, ++slowRunningCount);
+						++slowRunCount;
+					}
+
+					this_thread::sleep_for(milliseconds(200));
+
+					unique_lock<mutex> guard(lock);
+					--slowRunningCount;
+				});
+			}
+
+			scheduler.Add("fast", milliseconds(10), [&]()
+			{
+				unique_lock<mutex> guard(lock);
+				++fastRunCount;
+			});
+
+			auto stopRunCount = 0;
+			scheduler.Add("", milliseconds(1000), [&]()
+			{
+				if (++stopRunCount == 2)
+				{
+					scheduler.Stop();
+				}
+			});
+
+			scheduler.Run();
+			Print("slow runs: ", slowRunCount);
+			Print("fast runs: ", fastRunCount);
+			Print(slowPeakCount == 2 ? "groups keep their limits" : "groups exceed their limits");
 		}
 
 		void PrintCopyCounts()
@@ -1129,7 +1694,14 @@ namespace Integro
 		{
 			//LmdbTest();
 			//JsonBsonTest();
+			//BsonJsonTest();
 			//MaveTest();
+			//MavePerformanceTest();
+			//HashPerformanceTest();
+			//ParallelForTest();
+			//CopyStagesTest();
+			//CheckpointTest();
+			//SchedulerTest();
 			//PrintCopyCounts();
 
 			//CopyTds();
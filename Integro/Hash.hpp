@@ -1,6 +1,19 @@
 #pragma once
 
 #include <string>
+#include <cstring>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define INTEGRO_HASH_X86
+#if defined(_MSC_VER)
+#include <intrin.h>
+#include <immintrin.h>
+#define INTEGRO_HASH_TARGET(name)
+#else
+#include <x86intrin.h>
+#define INTEGRO_HASH_TARGET(name) __attribute__((target(name)))
+#endif
+#endif
 
 namespace Integro
 {
@@ -16,7 +29,8 @@ namespace Integro
 			unsigned char data
 			, int hash = HASH_SEED)
 	{
-		return (data ^ hash) * HASH_PRIME;
+		// unsigned arithmetic wraps where signed arithmetic would overflow, the result is the same
+		return (int)((data ^ (unsigned int)hash) * (unsigned int)HASH_PRIME);
 	}
 
 	int
@@ -38,4 +52,620 @@ namespace Integro
 	{
 		return Hash((const unsigned char*)data.c_str(), data.size());
 	}
+
+	// xxhash64, a streaming 64 bit hash that consumes 32 bytes per round,
+	// values depend only on the bytes and the seed, so they can be stored
+	class Hash64
+	{
+		static const unsigned long long prime1 = 11400714785074694791ULL;
+		static const unsigned long long prime2 = 14029467366897019727ULL;
+		static const unsigned long long prime3 = 1609587929392839161ULL;
+		static const unsigned long long prime4 = 9650029242287828579ULL;
+		static const unsigned long long prime5 = 2870177450012600261ULL;
+
+		unsigned long long seed_;
+		unsigned long long v1_, v2_, v3_, v4_;
+		unsigned long long length_;
+		unsigned char buffer_[32];
+		size_t size_;
+
+		static unsigned long long Rotate(const unsigned long long x, const int r) { return (x << r) | (x >> (64 - r)); }
+
+		static unsigned long long Read64(const unsigned char *p)
+		{
+			return (unsigned long long)p[0] | (unsigned long long)p[1] << 8 | (unsigned long long)p[2] << 16 | (unsigned long long)p[3] << 24
+				| (unsigned long long)p[4] << 32 | (unsigned long long)p[5] << 40 | (unsigned long long)p[6] << 48 | (unsigned long long)p[7] << 56;
+		}
+
+		static unsigned long long Read32(const unsigned char *p)
+		{
+			return (unsigned long long)p[0] | (unsigned long long)p[1] << 8 | (unsigned long long)p[2] << 16 | (unsigned long long)p[3] << 24;
+		}
+
+		static unsigned long long Round(unsigned long long acc, const unsigned long long input)
+		{
+			acc += input * prime2;
+			return Rotate(acc, 31) * prime1;
+		}
+
+		static unsigned long long Merge(const unsigned long long acc, const unsigned long long v)
+		{
+			return (acc ^ Round(0, v)) * prime1 + prime4;
+		}
+
+		void Consume(const unsigned char *p)
+		{
+			v1_ = Round(v1_, Read64(p));
+			v2_ = Round(v2_, Read64(p + 8));
+			v3_ = Round(v3_, Read64(p + 16));
+			v4_ = Round(v4_, Read64(p + 24));
+		}
+
+	public:
+		explicit Hash64(const unsigned long long seed = 0)
+			: seed_(seed)
+			, v1_(seed + prime1 + prime2)
+			, v2_(seed + prime2)
+			, v3_(seed)
+			, v4_(seed - prime1)
+			, length_(0)
+			, size_(0)
+		{
+		}
+
+		Hash64& Update(const void *data, size_t size)
+		{
+			auto p = (const unsigned char*)data;
+			length_ += size;
+
+			if (size_ + size < 32)
+			{
+				memcpy(buffer_ + size_, p, size);
+				size_ += size;
+				return *this;
+			}
+
+			if (size_ > 0)
+			{
+				auto n = 32 - size_;
+				memcpy(buffer_ + size_, p, n);
+				Consume(buffer_);
+				p += n;
+				size -= n;
+				size_ = 0;
+			}
+
+			for (; size >= 32; p += 32, size -= 32)
+			{
+				Consume(p);
+			}
+
+			memcpy(buffer_, p, size);
+			size_ = size;
+			return *this;
+		}
+
+		Hash64& Update(const string &data) { return Update(data.data(), data.size()); }
+
+		// does not change the state, more data can be added afterwards
+		unsigned long long Digest() const
+		{
+			unsigned long long h;
+
+			if (length_ >= 32)
+			{
+				h = Rotate(v1_, 1) + Rotate(v2_, 7) + Rotate(v3_, 12) + Rotate(v4_, 18);
+				h = Merge(h, v1_);
+				h = Merge(h, v2_);
+				h = Merge(h, v3_);
+				h = Merge(h, v4_);
+			}
+			else
+			{
+				h = seed_ + prime5;
+			}
+
+			h += length_;
+
+			auto p = buffer_;
+			auto e = buffer_ + size_;
+
+			for (; p + 8 <= e; p += 8)
+			{
+				h ^= Round(0, Read64(p));
+				h = Rotate(h, 27) * prime1 + prime4;
+			}
+
+			if (p + 4 <= e)
+			{
+				h ^= Read32(p) * prime1;
+				h = Rotate(h, 23) * prime2 + prime3;
+				p += 4;
+			}
+
+			for (; p < e; ++p)
+			{
+				h ^= *p * prime5;
+				h = Rotate(h, 11) * prime1;
+			}
+
+			h ^= h >> 33;
+			h *= prime2;
+			h ^= h >> 29;
+			h *= prime3;
+			h ^= h >> 32;
+			return h;
+		}
+	};
+
+	inline
+		unsigned long long
+		HashLong(
+			const void *data
+			, const size_t size
+			, const unsigned long long seed = 0)
+	{
+		return Hash64(seed).Update(data, size).Digest();
+	}
+
+	inline
+		unsigned long long
+		HashLong(
+			const string &data)
+	{
+		return HashLong(data.data(), data.size());
+	}
+
+	// instruction sets that hash kernels can use, detected once
+	struct HashCpu
+	{
+		bool sse2;
+		bool sse42;
+		bool avx2;
+
+		static const HashCpu& Get()
+		{
+			static const HashCpu cpu = Detect();
+			return cpu;
+		}
+
+	private:
+		static HashCpu Detect()
+		{
+			HashCpu cpu = { false, false, false };
+#if defined(INTEGRO_HASH_X86) && defined(_MSC_VER)
+			int info[4];
+			__cpuid(info, 0);
+			auto maxLeaf = info[0];
+			__cpuid(info, 1);
+			cpu.sse2 = (info[3] & (1 << 26)) != 0;
+			cpu.sse42 = (info[2] & (1 << 20)) != 0;
+			auto osAvx = (info[2] & (1 << 27)) != 0 && (info[2] & (1 << 28)) != 0 && (_xgetbv(0) & 6) == 6;
+			if (osAvx && maxLeaf >= 7)
+			{
+				__cpuidex(info, 7, 0);
+				cpu.avx2 = (info[1] & (1 << 5)) != 0;
+			}
+#elif defined(INTEGRO_HASH_X86)
+			__builtin_cpu_init();
+			cpu.sse2 = __builtin_cpu_supports("sse2") != 0;
+			cpu.sse42 = __builtin_cpu_supports("sse4.2") != 0;
+			cpu.avx2 = __builtin_cpu_supports("avx2") != 0;
+#endif
+			return cpu;
+		}
+	};
+
+	enum HashKernel
+	{
+		HASH_PORTABLE
+		, HASH_SSE2
+		, HASH_AVX2
+	};
+
+	struct Digest128
+	{
+		unsigned long long low;
+		unsigned long long high;
+
+		bool operator==(const Digest128 &other) const { return low == other.low && high == other.high; }
+		bool operator!=(const Digest128 &other) const { return !(*this == other); }
+		bool operator<(const Digest128 &other) const { return high < other.high || (high == other.high && low < other.low); }
+	};
+
+	// a streaming 128 bit hash for large inputs
+	// eight 64 bit lanes accumulate 64 byte stripes with 32x32 bit multiplies, so sse2 and avx2 kernels
+	// process two and four lanes per instruction, lanes are scrambled every 1 KB and folded at the end,
+	// all kernels produce the same values, so they can be stored
+	class Hash128
+	{
+		static const size_t laneCount = 8;
+		static const size_t stripeSize = 64;
+		static const size_t blockStripes = 16;
+		static const size_t secretSize = 48;
+		static const size_t scrambleKey = 24;
+		static const size_t lowKey = 32;
+		static const size_t highKey = 40;
+
+		typedef void(*Accumulator)(unsigned long long *acc, const unsigned char *data, size_t stripes, const unsigned long long *key);
+
+		unsigned long long seed_;
+		unsigned long long acc_[laneCount];
+		unsigned long long length_;
+		size_t stripe_;
+		unsigned char buffer_[stripeSize];
+		size_t size_;
+
+		// words of a splitmix64 sequence, stripe n of a block uses words n to n + 7
+		static const unsigned long long* Secret()
+		{
+			struct Table
+			{
+				unsigned long long words[secretSize];
+
+				Table()
+				{
+					unsigned long long x = 0;
+					for (auto &word : words)
+					{
+						auto z = (x += 0x9E3779B97F4A7C15ULL);
+						z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+						z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+						word = z ^ (z >> 31);
+					}
+				}
+			};
+
+			static const Table table;
+			return table.words;
+		}
+
+		static unsigned long long Read64(const unsigned char *p)
+		{
+			return (unsigned long long)p[0] | (unsigned long long)p[1] << 8 | (unsigned long long)p[2] << 16 | (unsigned long long)p[3] << 24
+				| (unsigned long long)p[4] << 32 | (unsigned long long)p[5] << 40 | (unsigned long long)p[6] << 48 | (unsigned long long)p[7] << 56;
+		}
+
+		static void AccumulatePortable(unsigned long long *acc, const unsigned char *data, size_t stripes, const unsigned long long *key)
+		{
+			for (; stripes > 0; --stripes, data += stripeSize, ++key)
+			{
+				for (size_t lane = 0; lane < laneCount; ++lane)
+				{
+					auto d = Read64(data + 8 * lane);
+					auto dk = d ^ key[lane];
+					acc[lane ^ 1] += d;
+					acc[lane] += (dk & 0xFFFFFFFF) * (dk >> 32);
+				}
+			}
+		}
+
+#ifdef INTEGRO_HASH_X86
+		INTEGRO_HASH_TARGET("sse2")
+		static void AccumulateSse2(unsigned long long *acc, const unsigned char *data, size_t stripes, const unsigned long long *key)
+		{
+			__m128i a[4];
+			for (int i = 0; i < 4; ++i)
+			{
+				a[i] = _mm_loadu_si128((const __m128i*)acc + i);
+			}
+
+			for (; stripes > 0; --stripes, data += stripeSize, ++key)
+			{
+				for (int i = 0; i < 4; ++i)
+				{
+					auto d = _mm_loadu_si128((const __m128i*)data + i);
+					auto dk = _mm_xor_si128(d, _mm_loadu_si128((const __m128i*)(key + 2 * i)));
+					auto product = _mm_mul_epu32(dk, _mm_srli_epi64(dk, 32));
+					auto swapped = _mm_shuffle_epi32(d, _MM_SHUFFLE(1, 0, 3, 2));
+					a[i] = _mm_add_epi64(a[i], _mm_add_epi64(product, swapped));
+				}
+			}
+
+			for (int i = 0; i < 4; ++i)
+			{
+				_mm_storeu_si128((__m128i*)acc + i, a[i]);
+			}
+		}
+
+		INTEGRO_HASH_TARGET("avx2")
+		static void AccumulateAvx2(unsigned long long *acc, const unsigned char *data, size_t stripes, const unsigned long long *key)
+		{
+			auto a0 = _mm256_loadu_si256((const __m256i*)acc);
+			auto a1 = _mm256_loadu_si256((const __m256i*)acc + 1);
+
+			for (; stripes > 0; --stripes, data += stripeSize, ++key)
+			{
+				auto d0 = _mm256_loadu_si256((const __m256i*)data);
+				auto d1 = _mm256_loadu_si256((const __m256i*)data + 1);
+				auto dk0 = _mm256_xor_si256(d0, _mm256_loadu_si256((const __m256i*)key));
+				auto dk1 = _mm256_xor_si256(d1, _mm256_loadu_si256((const __m256i*)(key + 4)));
+				a0 = _mm256_add_epi64(a0, _mm256_add_epi64(_mm256_mul_epu32(dk0, _mm256_srli_epi64(dk0, 32)), _mm256_shuffle_epi32(d0, _MM_SHUFFLE(1, 0, 3, 2))));
+				a1 = _mm256_add_epi64(a1, _mm256_add_epi64(_mm256_mul_epu32(dk1, _mm256_srli_epi64(dk1, 32)), _mm256_shuffle_epi32(d1, _MM_SHUFFLE(1, 0, 3, 2))));
+			}
+
+			_mm256_storeu_si256((__m256i*)acc, a0);
+			_mm256_storeu_si256((__m256i*)acc + 1, a1);
+		}
+#endif
+
+		struct Dispatch
+		{
+			HashKernel kernel;
+			Accumulator accumulator;
+		};
+
+		static Dispatch& Current()
+		{
+			static Dispatch dispatch = Select(Supports(HASH_AVX2) ? HASH_AVX2 : Supports(HASH_SSE2) ? HASH_SSE2 : HASH_PORTABLE);
+			return dispatch;
+		}
+
+		static bool Supports(const HashKernel kernel)
+		{
+#ifdef INTEGRO_HASH_X86
+			auto &cpu = HashCpu::Get();
+			return kernel == HASH_AVX2 ? cpu.avx2 : kernel == HASH_SSE2 ? cpu.sse2 : true;
+#else
+			return kernel == HASH_PORTABLE;
+#endif
+		}
+
+		static Dispatch Select(const HashKernel kernel)
+		{
+			switch (kernel)
+			{
+#ifdef INTEGRO_HASH_X86
+				case HASH_AVX2: return{ kernel, AccumulateAvx2 };
+				case HASH_SSE2: return{ kernel, AccumulateSse2 };
+#endif
+				default: return{ HASH_PORTABLE, AccumulatePortable };
+			}
+		}
+
+		static void Scramble(unsigned long long *acc)
+		{
+			auto key = Secret() + scrambleKey;
+			for (size_t lane = 0; lane < laneCount; ++lane)
+			{
+				acc[lane] = ((acc[lane] ^ (acc[lane] >> 47)) ^ key[lane]) * 0x9E3779B1ULL;
+			}
+		}
+
+		// xors the halves of a 128 bit product
+		static unsigned long long Fold(const unsigned long long a, const unsigned long long b)
+		{
+			auto ll = (a & 0xFFFFFFFF) * (b & 0xFFFFFFFF);
+			auto lh = (a & 0xFFFFFFFF) * (b >> 32);
+			auto hl = (a >> 32) * (b & 0xFFFFFFFF);
+			auto hh = (a >> 32) * (b >> 32);
+			auto cross = (ll >> 32) + (lh & 0xFFFFFFFF) + hl;
+			return ((cross << 32) | (ll & 0xFFFFFFFF)) ^ (hh + (lh >> 32) + (cross >> 32));
+		}
+
+		static unsigned long long Merge(const unsigned long long *acc, const unsigned long long *key, unsigned long long h)
+		{
+			for (size_t lane = 0; lane < laneCount; lane += 2)
+			{
+				h += Fold(acc[lane] ^ key[lane], acc[lane + 1] ^ key[lane + 1]);
+			}
+
+			h ^= h >> 37;
+			h *= 0x165667919E3779F9ULL;
+			h ^= h >> 32;
+			return h;
+		}
+
+		void Accumulate(const unsigned char *data, size_t stripes)
+		{
+			auto accumulate = Current().accumulator;
+
+			while (stripes > 0)
+			{
+				auto n = blockStripes - stripe_ < stripes ? blockStripes - stripe_ : stripes;
+				accumulate(acc_, data, n, Secret() + stripe_);
+				data += n * stripeSize;
+				stripes -= n;
+
+				if ((stripe_ += n) == blockStripes)
+				{
+					Scramble(acc_);
+					stripe_ = 0;
+				}
+			}
+		}
+
+	public:
+		explicit Hash128(const unsigned long long seed = 0)
+			: seed_(seed)
+			, length_(0)
+			, stripe_(0)
+			, size_(0)
+		{
+			static const unsigned long long init[laneCount] = {
+				0xC2B2AE3DULL, 0x9E3779B185EBCA87ULL, 0xC2B2AE3D27D4EB4FULL, 0x165667B19E3779F9ULL
+				, 0x85EBCA77C2B2AE63ULL, 0x85EBCA77ULL, 0x27D4EB2F165667C5ULL, 0x9E3779B1ULL };
+
+			for (size_t lane = 0; lane < laneCount; ++lane)
+			{
+				acc_[lane] = init[lane] + seed;
+			}
+		}
+
+		// the kernel used by all hashes of the process, the fastest supported one by default
+		static HashKernel Kernel() { return Current().kernel; }
+
+		// meant for tests and benchmarks, returns false if the cpu does not support the kernel
+		static bool UseKernel(const HashKernel kernel)
+		{
+			if (!Supports(kernel))
+			{
+				return false;
+			}
+
+			Current() = Select(kernel);
+			return true;
+		}
+
+		Hash128& Update(const void *data, size_t size)
+		{
+			auto p = (const unsigned char*)data;
+			length_ += size;
+
+			if (size_ > 0)
+			{
+				auto n = stripeSize - size_ < size ? stripeSize - size_ : size;
+				memcpy(buffer_ + size_, p, n);
+				p += n;
+				size -= n;
+
+				if ((size_ += n) < stripeSize)
+				{
+					return *this;
+				}
+
+				Accumulate(buffer_, 1);
+				size_ = 0;
+			}
+
+			Accumulate(p, size / stripeSize);
+			p += size / stripeSize * stripeSize;
+			size %= stripeSize;
+
+			memcpy(buffer_, p, size);
+			size_ = size;
+			return *this;
+		}
+
+		Hash128& Update(const string &data) { return Update(data.data(), data.size()); }
+
+		// does not change the state, more data can be added afterwards
+		Digest128 Digest() const
+		{
+			unsigned long long acc[laneCount];
+			memcpy(acc, acc_, sizeof(acc));
+
+			// the tail is padded with zeros, the length tells the padding apart from data
+			unsigned char tail[stripeSize] = {};
+			memcpy(tail, buffer_, size_);
+			AccumulatePortable(acc, tail, 1, Secret() + stripe_);
+
+			Digest128 result;
+			result.low = Merge(acc, Secret() + lowKey, length_ * 0x9E3779B185EBCA87ULL ^ seed_);
+			result.high = Merge(acc, Secret() + highKey, ~(length_ * 0xC2B2AE3D27D4EB4FULL) ^ seed_);
+			return result;
+		}
+	};
+
+	inline
+		Digest128
+		HashWide(
+			const void *data
+			, const size_t size
+			, const unsigned long long seed = 0)
+	{
+		return Hash128(seed).Update(data, size).Digest();
+	}
+
+	inline
+		Digest128
+		HashWide(
+			const string &data)
+	{
+		return HashWide(data.data(), data.size());
+	}
+
+	// crc32c (castagnoli), with the sse4.2 crc32 instruction when available,
+	// meant for checksums of stored data rather than for hash tables
+	class Crc32c
+	{
+		typedef unsigned int(*Kernel)(unsigned int crc, const unsigned char *data, size_t size);
+
+		unsigned int crc_;
+
+		static unsigned int UpdatePortable(unsigned int crc, const unsigned char *data, size_t size)
+		{
+			struct Table
+			{
+				unsigned int values[256];
+
+				Table()
+				{
+					for (unsigned int i = 0; i < 256; ++i)
+					{
+						auto c = i;
+						for (int k = 0; k < 8; ++k)
+						{
+							c = c & 1 ? (c >> 1) ^ 0x82F63B78 : c >> 1;
+						}
+						values[i] = c;
+					}
+				}
+			};
+
+			static const Table table;
+
+			for (; size > 0; --size)
+			{
+				crc = table.values[(crc ^ *data++) & 0xFF] ^ (crc >> 8);
+			}
+
+			return crc;
+		}
+
+#ifdef INTEGRO_HASH_X86
+		INTEGRO_HASH_TARGET("sse4.2")
+		static unsigned int UpdateSse42(unsigned int crc, const unsigned char *data, size_t size)
+		{
+#if defined(_M_X64) || defined(__x86_64__)
+			unsigned long long c = crc;
+			for (; size >= 8; size -= 8, data += 8)
+			{
+				unsigned long long word;
+				memcpy(&word, data, 8);
+				c = _mm_crc32_u64(c, word);
+			}
+			crc = (unsigned int)c;
+#else
+			for (; size >= 4; size -= 4, data += 4)
+			{
+				unsigned int word;
+				memcpy(&word, data, 4);
+				crc = _mm_crc32_u32(crc, word);
+			}
+#endif
+			for (; size > 0; --size)
+			{
+				crc = _mm_crc32_u8(crc, *data++);
+			}
+
+			return crc;
+		}
+#endif
+
+		static Kernel Select()
+		{
+#ifdef INTEGRO_HASH_X86
+			if (HashCpu::Get().sse42)
+			{
+				return UpdateSse42;
+			}
+#endif
+			return UpdatePortable;
+		}
+
+	public:
+		Crc32c() : crc_(0xFFFFFFFF) {}
+
+		Crc32c& Update(const void *data, const size_t size)
+		{
+			static const Kernel kernel = Select();
+			crc_ = kernel(crc_, (const unsigned char*)data, size);
+			return *this;
+		}
+
+		Crc32c& Update(const string &data) { return Update(data.data(), data.size()); }
+
+		unsigned int Digest() const { return crc_ ^ 0xFFFFFFFF; }
+	};
 }
\ No newline at end of file
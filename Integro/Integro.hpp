@@ -11,6 +11,7 @@
 #include "spdlog/spdlog.h"
 
 #include "Copy.hpp"
+#include "Scheduler.hpp"
 
 namespace Integro
 {
@@ -71,6 +72,8 @@ namespace Integro
 		Json config;
 		string environment;
 		string metadataPath;
+		string duplicateIndexPath;
+		bool isRebuildingDuplicateIndexes;
 
 		void
 			Proceed(
@@ -188,22 +191,66 @@ namespace Integro
 			return strings;
 		}
 
+		// "maxQueueCount" datums and "maxQueueSize" bytes of a topic, 0 does not limit the size
 		auto
-			CreateTdsActions()
+			CreateCopyBudget(
+				const Json &topic)
 		{
-			vector<pair<string, function<void()>>> actions;
+			auto &maxQueueCount = topic["maxQueueCount"];
+			auto &maxQueueSize = topic["maxQueueSize"];
+			size_t maxCount = maxQueueCount.int_value() > 0 ? maxQueueCount.int_value() : 10000;
+			size_t maxSize = !maxQueueSize.is_number() ? 256 * 1024 * 1024 : maxQueueSize.number_value() > 0 ? (size_t)maxQueueSize.number_value() : 0;
+			return make_shared<Copy::CopyBudget>(maxCount, maxSize);
+		}
+
+		// start times are written after "checkpoint count" updates or "checkpoint interval ms" after the first one,
+		// an interval that is not positive writes every update
+		auto
+			CreateCheckpointManager(
+				const Json &settings)
+		{
+			auto &checkpointCount = settings["checkpoint count"];
+			auto &checkpointInterval = settings["checkpoint interval ms"];
+			size_t maxPendingCount = checkpointCount.int_value() > 0 ? checkpointCount.int_value() : 100;
+			auto maxPendingTime = milliseconds(!checkpointInterval.is_number() ? 5000 : checkpointInterval.int_value() > 0 ? checkpointInterval.int_value() : 0);
+			return make_shared<Copy::CheckpointManager>(metadataPath, maxPendingCount, maxPendingTime);
+		}
+
+		string
+			ToString(
+				const Copy::CopyBudget &budget)
+		{
+			return to_string(budget.peakCount.load()) + " datums and " + to_string(budget.peakSize.load() / (1024 * 1024)) + " MB";
+		}
 
+		// topics run every "sleep ms" of a topic or of the program after their previous copy,
+		// topics of a server run at most "concurrency" of its connection or "connection concurrency" of the program at once
+		void
+			CreateTdsActions(
+				Scheduler &scheduler
+				, shared_ptr<Copy::CheckpointManager> checkpoints)
+		{
 			auto &mongo = config["mongo"];
 			auto &elastic = config["elastic"];
 			auto &tds = config["tds"];
 
 			auto &mongoConnectionOne = mongo["connections"]["one"][environment];
 			auto &elasticConnectionOne = elastic["connections"]["one"][environment];
+			auto useDuplicateIndex = tds["settings"]["program"]["dedup index"].bool_value();
+			// the local duplicate index already avoids remote lookups, the filter only fronts the remote ones
+			auto useBloomFilter = !useDuplicateIndex && tds["settings"]["program"]["dedup bloom filter"] != Json(false);
+			auto &duplicateCacheSize = tds["settings"]["program"]["dedup cache size"];
+			size_t duplicateCacheCapacity = !duplicateCacheSize.is_number() ? 10000 : duplicateCacheSize.int_value() > 0 ? duplicateCacheSize.int_value() : 0;
+			auto &period = tds["settings"]["program"]["sleep ms"];
+			auto &connectionConcurrency = tds["settings"]["program"]["connection concurrency"];
+			int i = 0;
 
 			for (auto &channel : tds["channels"].object_items())
 			{
 				auto &proxy = tds["proxies"][channel.first][environment];
 				auto &connection = tds["connections"][channel.first][environment];
+				auto &concurrency = connection["concurrency"].is_number() ? connection["concurrency"] : connectionConcurrency;
+				scheduler.SetLimit(channel.first, concurrency.int_value() > 0 ? concurrency.int_value() : 2);
 
 				for (auto &topic : channel.second.array_items())
 				{
@@ -231,44 +278,158 @@ namespace Integro
 
 					auto LoadData = Copy::LoadDataTds(tdsHost, tdsUser, tdsPassword, tdsDatabase, tdsQuery);
 					auto ProcessData = Copy::ProcessDataTds(channelName, modelName, model, action, targetStores);
-					auto LoadDuplicateData = Copy::LoadDuplicateDataMongo(mongoUrl, mongoDatabase, mongoCollection, descriptorAttribute);
-					auto RemoveDuplicates = Copy::RemoveDuplicates(descriptorAttribute, sourceAttribute, LoadDuplicateData);
+					// tds ids are generated, so only equal sources are coalesced
+					auto CoalesceData = Copy::CoalesceData(sourceAttribute, false);
+					auto duplicateIndexPathOne = duplicateIndexPath + "/" + mongoCollection;
+					auto bloomFilterPathOne = duplicateIndexPathOne + ".bloom";
+					auto LoadDuplicateDataMongo = Copy::LoadDuplicateDataMongo(mongoUrl, mongoDatabase, mongoCollection, descriptorAttribute);
+					auto LoadDescriptors = Copy::LoadDescriptorsMongo(mongoUrl, mongoDatabase, mongoCollection, descriptorAttribute);
+					auto LoadDuplicateData = useBloomFilter
+						? function<void(const string&, vector<long long>&, function<void(Mave::Mave&)>)>(Copy::LoadDuplicateDataBloom(bloomFilterPathOne, LoadDuplicateDataMongo, LoadDescriptors))
+						: function<void(const string&, vector<long long>&, function<void(Mave::Mave&)>)>(LoadDuplicateDataMongo);
+					auto RemoveDuplicatesStored = useDuplicateIndex
+						? function<void(vector<Mave::Mave>&)>(Copy::RemoveDuplicatesLmdb(descriptorAttribute, sourceAttribute, idAttribute, duplicateIndexPathOne, LoadDuplicateData))
+						: function<void(vector<Mave::Mave>&)>(Copy::RemoveDuplicates(descriptorAttribute, sourceAttribute, LoadDuplicateData));
+					auto duplicateCache = make_shared<Copy::DuplicateCache>(duplicateCacheCapacity);
+					auto RemoveDuplicatesCached = Copy::RemoveDuplicatesCached(descriptorAttribute, sourceAttribute, duplicateCache, RemoveDuplicatesStored);
+					auto SaveDuplicateCache = Copy::SaveDuplicateCache(duplicateCache);
+					auto SaveDuplicateIndex = Copy::SaveDuplicateIndexLmdb(sourceAttribute, idAttribute, duplicateIndexPathOne);
+					auto MigrateDescriptors = Copy::MigrateDescriptorsMongo(mongoUrl, mongoDatabase, mongoCollection, descriptorAttribute, sourceAttribute, checkpoints, metadataKey + ".descriptorVersion");
 					auto SaveDataMongo = Copy::SaveDataMongo(mongoUrl, mongoDatabase, mongoCollection);
 					auto SaveDataElastic = Copy::SaveDataElastic(elasticUrl, elasticIndex, elasticType);
+					vector<function<void(vector<Mave::Mave>&)>> stores = { SaveDataMongo };
+
+					// TEMPORARY SOLUTION NOTICE:
+					// disable saving to elasticsearch if it is not present in config.json
+					if (elasticUrl != ":")
+					{
+						stores.push_back(SaveDataElastic);
+					}
+
+					auto SaveDataStores = Copy::SaveDataConcurrently(stores);
 					auto SaveData = [=](vector<Mave::Mave> &data) mutable
 					{
 						ProcessData(data);
-						RemoveDuplicates(data);
-						SaveDataMongo(data);
+						CoalesceData(data);
+						// the sources of a batch are cached after that batch is saved
+						Copy::DuplicateCache::Sources cachedSources;
 
-						// TEMPORARY SOLUTION NOTICE:
-						// disable saving to elasticsearch if it is not present in config.json
-						if (elasticUrl != ":")
+						if (duplicateCacheCapacity != 0)
+						{
+							cachedSources = RemoveDuplicatesCached(data);
+						}
+						else
+						{
+							RemoveDuplicatesStored(data);
+						}
+
+						SaveDataStores(data);
+						SaveDuplicateCache(cachedSources);
+
+						if (useDuplicateIndex)
 						{
-							SaveDataElastic(data);
+							SaveDuplicateIndex(data);
 						}
 					};
-					auto LoadStartTime = Copy::LoadStartTimeLmdb(metadataPath, metadataKey);
-					auto SaveStartTime = Copy::SaveStartTimeLmdb(metadataPath, metadataKey);
+					auto LoadStartTime = Copy::LoadStartTimeCheckpoint(checkpoints, metadataKey);
+					auto SaveStartTime = Copy::SaveStartTimeCheckpoint(checkpoints, metadataKey);
 					auto GetTime = Copy::GetTimeTds(timeAttribute);
+					auto GetSize = [](Mave::Mave &datum) { return Mave::EstimateSize(datum); };
+					auto budget = CreateCopyBudget(topic);
 					auto CopyData = [=]() mutable
 					{
+						MigrateDescriptors();
+
 						// TEMPORARY SOLUTION NOTICE:
 						// Change to Copy::CopyDataInChunks when all tds queries provide sorted data
 
-						//Copy::CopyDataInChunks<Mave::Mave, milliseconds>(LoadData, SaveData, LoadStartTime, SaveStartTime, GetTime);
-						Copy::CopyDataInBulk<Mave::Mave, milliseconds>(LoadData, SaveData, LoadStartTime, SaveStartTime, GetTime);
+						//Copy::CopyDataInChunks<Mave::Mave, milliseconds>(LoadData, SaveData, LoadStartTime, SaveStartTime, GetTime, GetSize, budget);
+						Copy::CopyDataInBulk<Mave::Mave, milliseconds>(LoadData, SaveData, LoadStartTime, SaveStartTime, GetTime, GetSize, budget);
+						OnEvent("'" + action + "' has held at most " + ToString(*budget));
+
+						if (duplicateCacheCapacity != 0)
+						{
+							OnEvent("duplicate cache of '" + mongoCollection + "' has " + to_string(duplicateCache->sources.Size())
+								+ " sources, " + to_string(duplicateCache->sources.Hits()) + " hits and " + to_string(duplicateCache->sources.Misses()) + " misses");
+						}
 					};
 
-					actions.push_back(make_pair(action, CopyData));
+					if (useDuplicateIndex && !boost::filesystem::is_directory(duplicateIndexPathOne))
+					{
+						boost::filesystem::create_directories(duplicateIndexPathOne);
+					}
+
+					if (!boost::filesystem::is_directory(duplicateIndexPath))
+					{
+						boost::filesystem::create_directories(duplicateIndexPath);
+					}
+
+					// a filter that missed saves would give false negatives, so it is rebuilt when enabled again
+					if (!useBloomFilter)
+					{
+						boost::filesystem::remove(bloomFilterPathOne);
+						boost::filesystem::remove(bloomFilterPathOne + ".journal");
+					}
+
+					auto topicPeriod = milliseconds(topic["sleep ms"].is_number() ? topic["sleep ms"].int_value() : period.int_value());
+					auto actionNumber = ++i;
+					scheduler.Add(channel.first, topicPeriod, [=]() mutable
+					{
+						OnEvent("tds action # " + to_string(actionNumber) + " is starting, action name is '" + action + "'");
+						Proceed(CopyData, OnError);
+						OnEvent("tds action '" + action + "' is being paused for " + to_string(topicPeriod.count()) + " milliseconds");
+					});
 				}
 			}
 
-			return actions;
+			// start times that are still pending are written when topics pause, none are pending without an interval
+			if (checkpoints->MaxPendingTime() > milliseconds::zero())
+			{
+				scheduler.Add("", checkpoints->MaxPendingTime(), [=]()
+				{
+					Proceed([&]() { checkpoints->Flush(); }, OnError);
+				});
+			}
+		}
+
+		// rebuilds the duplicate indexes of tds topics from mongodb
+		void
+			RebuildDuplicateIndexes()
+		{
+			auto &mongo = config["mongo"];
+			auto &tds = config["tds"];
+
+			auto &mongoConnectionOne = mongo["connections"]["one"][environment];
+
+			for (auto &channel : tds["channels"].object_items())
+			{
+				for (auto &topic : channel.second.array_items())
+				{
+					auto mongoUrl = "mongodb://" + mongoConnectionOne["host"].string_value() + ":" + mongoConnectionOne["port"].string_value();
+					auto mongoDatabase = mongoConnectionOne["database"].string_value();
+					auto mongoCollection = topic["name"].string_value();
+					auto idAttribute = "_id";
+					auto sourceAttribute = "source";
+					auto duplicateIndexPathOne = duplicateIndexPath + "/" + mongoCollection;
+
+					if (!boost::filesystem::is_directory(duplicateIndexPathOne))
+					{
+						boost::filesystem::create_directories(duplicateIndexPathOne);
+					}
+
+					OnEvent("duplicate index of '" + mongoCollection + "' is being rebuilt");
+					Proceed([&]()
+					{
+						Copy::RebuildDuplicateIndexMongo(mongoUrl, mongoDatabase, mongoCollection, sourceAttribute, idAttribute, duplicateIndexPathOne);
+						OnEvent("duplicate index of '" + mongoCollection + "' has been rebuilt");
+					}, OnError);
+				}
+			}
 		}
 
 		auto
-			CreateLdapActions()
+			CreateLdapActions(
+				shared_ptr<Copy::CheckpointManager> checkpoints)
 		{
 			vector<pair<string, function<void()>>> actions;
 
@@ -279,6 +440,20 @@ namespace Integro
 			auto &mongoConnectionOne = mongo["connections"]["one"][environment];
 			auto &elasticConnectionOne = elastic["connections"]["one"][environment];
 
+			// attributes that change without a change of an entry are not fingerprinted,
+			// multi-valued attributes are sets unless only some are listed in "fingerprint sets"
+			auto &fingerprintSettings = ldap["settings"]["program"];
+			auto ignoredAttributeList = fingerprintSettings["fingerprint ignore"].is_array()
+				? ToStringVector(fingerprintSettings["fingerprint ignore"])
+				: vector<string>({ "uSNChanged", "whenChanged", "dSCorePropagationData" });
+			auto setAttributeList = ToStringVector(fingerprintSettings["fingerprint sets"]);
+			set<string> ignoredAttributes(ignoredAttributeList.begin(), ignoredAttributeList.end());
+			set<string> setAttributes(setAttributeList.begin(), setAttributeList.end());
+			auto areVectorsSets = !fingerprintSettings["fingerprint sets"].is_array();
+			// processing keeps no state between batches, so it can run on several batches at once
+			auto &processConcurrency = ldap["settings"]["program"]["process concurrency"];
+			size_t processStageConcurrency = processConcurrency.int_value() > 0 ? processConcurrency.int_value() : 2;
+
 			for (auto &channel : ldap["channels"].object_items())
 			{
 				auto &connection = ldap["connections"][channel.first][environment];
@@ -307,30 +482,85 @@ namespace Integro
 
 					auto LoadData = Copy::LoadDataLdap(ldapHost, ldapPort, ldapUser, ldapPassword, ldapNode, ldapFilter, ldapIdAttribute, timeAttribute, OnError, OnEvent);
 					auto ProcessDataMongo = Copy::ProcessDataLdap(ldapIdAttribute, channelName, modelName, model, action);
+					auto CoalesceData = Copy::CoalesceData("_id", true);
+					auto fingerprintPathOne = duplicateIndexPath + "/" + mongoCollection;
+					auto elasticFingerprintPathOne = fingerprintPathOne + ".elastic";
+					auto Fingerprint = [=](const Mave::Mave &source) { return Mave::Fingerprint(source, ignoredAttributes, setAttributes, areVectorsSets); };
+					// each sink keeps fingerprints of what it has saved, so it skips unchanged entries on its own
+					auto SaveChangedData = [=](const string &fingerprintPath, function<void(vector<Mave::Mave>&)> SaveData)
+					{
+						auto fingerprints = make_shared<Copy::PendingFingerprints>();
+						auto RemoveUnchanged = Copy::RemoveUnchangedLmdb("_id", "source", fingerprintPath, Fingerprint, fingerprints);
+						auto SaveFingerprints = Copy::SaveFingerprintsLmdb(fingerprintPath, fingerprints);
+
+						return [=](vector<Mave::Mave> &data) mutable
+						{
+							fingerprints->Clear();
+							RemoveUnchanged(data);
+							SaveData(data);
+							SaveFingerprints();
+						};
+					};
 					auto SaveDataMongo = Copy::SaveDataMongo(mongoUrl, mongoDatabase, mongoCollection);
 					auto ProcessDataElastic = Copy::ProcessDataLdapElastic();
 					auto SaveDataElastic = Copy::SaveDataElastic(elasticUrl, elasticIndex, elasticType);
-					auto SaveData = [=](vector<Mave::Mave> &data) mutable
+					auto ProcessData = [=](vector<Mave::Mave> &data) mutable
 					{
 						ProcessDataMongo(data);
-						SaveDataMongo(data);
-
-						// TEMPORARY SOLUTION NOTICE:
-						// disable saving to elasticsearch if it is not present in config.json
-						if (elasticUrl != ":")
+						CoalesceData(data);
+					};
+					auto SaveDataElasticLdap = [=](vector<Mave::Mave> &data) mutable
+					{
+						ProcessDataElastic(data);
+						SaveDataElastic(data);
+					};
+					vector<Copy::CopyStage<Mave::Mave>> stages = { { ProcessData, processStageConcurrency } };
+					vector<Copy::CopySink<Mave::Mave, milliseconds>> sinks =
+					{
 						{
-							ProcessDataElastic(data);
-							SaveDataElastic(data);
+							SaveChangedData(fingerprintPathOne, SaveDataMongo)
+							, Copy::LoadStartTimeCheckpoint(checkpoints, metadataKey)
+							, Copy::SaveStartTimeCheckpoint(checkpoints, metadataKey)
 						}
 					};
-					auto LoadStartTime = Copy::LoadStartTimeLmdb(metadataPath, metadataKey);
-					auto SaveStartTime = Copy::SaveStartTimeLmdb(metadataPath, metadataKey);
+
+					// TEMPORARY SOLUTION NOTICE:
+					// disable saving to elasticsearch if it is not present in config.json
+					if (elasticUrl != ":")
+					{
+						// elasticsearch starts where both stores stopped when they shared a start time and fingerprints
+						sinks.push_back(
+						{
+							SaveChangedData(elasticFingerprintPathOne, SaveDataElasticLdap)
+							, Copy::LoadStartTimeCheckpoint(checkpoints, metadataKey + ".elastic", metadataKey)
+							, Copy::SaveStartTimeCheckpoint(checkpoints, metadataKey + ".elastic")
+						});
+
+						if (!boost::filesystem::is_directory(elasticFingerprintPathOne))
+						{
+							boost::filesystem::create_directories(elasticFingerprintPathOne);
+
+							if (boost::filesystem::exists(fingerprintPathOne + "/data.mdb"))
+							{
+								boost::filesystem::copy_file(fingerprintPathOne + "/data.mdb", elasticFingerprintPathOne + "/data.mdb");
+							}
+						}
+					}
+
 					auto GetTime = Copy::GetTimeLdap(timeAttribute);
+					auto GetSize = [](Mave::Mave &datum) { return Mave::EstimateSize(datum); };
+					auto budget = CreateCopyBudget(topic);
 					auto CopyData = [=]() mutable
 					{
-						Copy::CopyDataInChunks<Mave::Mave, milliseconds>(LoadData, SaveData, LoadStartTime, SaveStartTime, GetTime);
+						Copy::CopyDataToSinks<Mave::Mave, milliseconds>(LoadData, stages, sinks, GetTime, GetSize, budget);
+						OnEvent("'" + action + "' has held at most " + ToString(*budget));
 					};
 
+					if (!boost::filesystem::is_directory(fingerprintPathOne))
+					{
+						boost::filesystem::create_directories(fingerprintPathOne);
+					}
+
 					actions.push_back(make_pair(action, CopyData));
 				}
 			}
@@ -343,6 +573,7 @@ namespace Integro
 			int argc
 			, wchar_t* argv[])
 			: isInitialized(false)
+			, isRebuildingDuplicateIndexes(false)
 		{
 			using namespace boost::filesystem;
 
@@ -362,17 +593,27 @@ namespace Integro
 				return;
 			}
 
-			if (argc != 3
+			duplicateIndexPath = "dedup";
+
+			if (!is_directory(duplicateIndexPath) && !create_directory(duplicateIndexPath))
+			{
+				OnError("failed to create '" + duplicateIndexPath + "' directory");
+				return;
+			}
+
+			if ((argc != 3 && argc != 4)
 				|| string((char*)argv[1]) != "--env"
 				|| (string((char*)argv[2]) != "dev"
 					&& string((char*)argv[2]) != "staging"
-					&& string((char*)argv[2]) != "prod"))
+					&& string((char*)argv[2]) != "prod")
+				|| (argc == 4 && string((char*)argv[3]) != "--rebuild-dedup-index"))
 			{
-				OnError("[--env {dev, staging, prod}]");
+				OnError("[--env {dev, staging, prod}] [--rebuild-dedup-index]");
 				return;
 			}
 
 			environment = (char*)argv[2];
+			isRebuildingDuplicateIndexes = argc == 4;
 
 			stringstream configBuffer;
 			std::ifstream configInput("configs\\config.json");
@@ -396,28 +637,27 @@ namespace Integro
 				return;
 			}
 
-			auto ExecuteTdsAction = [&]()
+			if (isRebuildingDuplicateIndexes)
 			{
-				auto period = milliseconds(config["tds"]["settings"]["program"]["sleep ms"].int_value());
-				auto actions = CreateTdsActions();
+				RebuildDuplicateIndexes();
+				return;
+			}
 
-				while (true)
-				{
-					int i = 0;
-					for (auto action : actions)
-					{
-						OnEvent("tds action # " + to_string(++i) + " is starting, action name is '" + action.first + "'");
-						Proceed(action.second, OnError);
-					}
+			// tds and ldap topics share one manager, so start times of both are written to the metadata directory under one lock
+			auto checkpoints = CreateCheckpointManager(config["tds"]["settings"]["program"]);
 
-					OnEvent("tds actions are being paused for " + to_string(period.count()) + " milliseconds");
-					this_thread::sleep_for(period);
-				}
+			// tds topics run on "concurrency" threads of the program, one for each core by default
+			auto ExecuteTdsAction = [&]()
+			{
+				auto &concurrency = config["tds"]["settings"]["program"]["concurrency"];
+				Scheduler scheduler(concurrency.int_value() > 0 ? concurrency.int_value() : thread::hardware_concurrency());
+				CreateTdsActions(scheduler, checkpoints);
+				scheduler.Run();
 			};
 
 			auto ExecuteLdapAction = [&]()
 			{
-				auto actions = CreateLdapActions();
+				auto actions = CreateLdapActions(checkpoints);
 
 				while (true)
 				{
@@ -427,6 +667,8 @@ namespace Integro
 						OnEvent("ldap action # " + to_string(++i) + " is starting, action name is '" + action.first + "'");
 						Proceed(action.second, OnError);
 					}
+
+					Proceed([&]() { checkpoints->Flush(); }, OnError);
 				}
 			};
 
@@ -0,0 +1,119 @@
+#pragma once
+
+#include <list>
+#include <unordered_map>
+#include <utility>
+
+namespace Integro
+{
+	using std::list;
+	using std::unordered_map;
+	using std::pair;
+
+	// a bounded map that evicts the least recently used item, not thread-safe
+	template <
+		typename K
+		, typename V>
+		class LruCache
+	{
+		size_t capacity_;
+		// most recently used items first
+		list<pair<K, V>> items_;
+		unordered_map<K, typename list<pair<K, V>>::iterator> index_;
+		unsigned long long hits_;
+		unsigned long long misses_;
+
+	public:
+		LruCache(
+			const size_t capacity)
+			: capacity_(capacity)
+			, hits_(0)
+			, misses_(0)
+		{
+		}
+
+		// returns nullptr if there is no such key, the pointer is valid until the next Put
+		const V*
+			Get(
+				const K &key)
+		{
+			auto i = index_.find(key);
+
+			if (i == index_.end())
+			{
+				++misses_;
+				return nullptr;
+			}
+
+			++hits_;
+			items_.splice(items_.begin(), items_, i->second);
+			return &i->second->second;
+		}
+
+		// like Get, but only a key with an equal value is a hit
+		bool
+			Contains(
+				const K &key
+				, const V &value)
+		{
+			auto i = index_.find(key);
+
+			if (i == index_.end() || !(i->second->second == value))
+			{
+				++misses_;
+				return false;
+			}
+
+			++hits_;
+			items_.splice(items_.begin(), items_, i->second);
+			return true;
+		}
+
+		void
+			Put(
+				const K &key
+				, const V &value)
+		{
+			if (capacity_ == 0)
+			{
+				return;
+			}
+
+			auto i = index_.find(key);
+
+			if (i != index_.end())
+			{
+				i->second->second = value;
+				items_.splice(items_.begin(), items_, i->second);
+				return;
+			}
+
+			if (items_.size() == capacity_)
+			{
+				index_.erase(items_.back().first);
+				items_.pop_back();
+			}
+
+			items_.emplace_front(key, value);
+			index_.insert({ key, items_.begin() });
+		}
+
+		size_t
+			Size() const
+		{
+			return items_.size();
+		}
+
+		unsigned long long
+			Hits() const
+		{
+			return hits_;
+		}
+
+		unsigned long long
+			Misses() const
+		{
+			return misses_;
+		}
+	};
+}
\ No newline at end of file
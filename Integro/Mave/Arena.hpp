@@ -0,0 +1,198 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+#include <vector>
+#include <atomic>
+
+namespace Integro
+{
+	namespace Mave
+	{
+		using std::size_t;
+		using std::vector;
+
+		// a monotonic buffer for maves of one batch
+		// allocations bump a pointer, deallocations only count down,
+		// all blocks are freed at once when an arena is retired and its last allocation is released
+		class Arena final
+		{
+			static const size_t alignment = alignof(std::max_align_t);
+			static const size_t header = alignment < sizeof(void*) ? sizeof(void*) : alignment;
+
+			std::atomic<long> count_;
+			size_t blockSize_;
+			size_t size_;
+			char *position_;
+			char *end_;
+			vector<char*> blocks_;
+
+			Arena(const size_t blockSize) : count_(1), blockSize_(blockSize), size_(0), position_(nullptr), end_(nullptr) {}
+
+			~Arena()
+			{
+				for (auto block : blocks_)
+				{
+					free(block);
+				}
+			}
+
+			static Arena*& Current()
+			{
+				static thread_local Arena *current = nullptr;
+				return current;
+			}
+
+			char* AllocateBlock(const size_t size)
+			{
+				auto block = (char*)malloc(size);
+
+				if (block == nullptr)
+				{
+					throw std::bad_alloc();
+				}
+
+				blocks_.push_back(block);
+				return block;
+			}
+
+			char* Bump(const size_t size)
+			{
+				char *p;
+
+				if (size > blockSize_ / 8)
+				{
+					p = AllocateBlock(size);
+				}
+				else
+				{
+					if (position_ == nullptr || (size_t)(end_ - position_) < size)
+					{
+						position_ = AllocateBlock(blockSize_);
+						end_ = position_ + blockSize_;
+					}
+
+					p = position_;
+					position_ += size;
+				}
+
+				size_ += size;
+				++count_;
+				return p;
+			}
+
+			void Release()
+			{
+				if (--count_ == 0)
+				{
+					delete this;
+				}
+			}
+
+		public:
+			Arena(const Arena&) = delete;
+			Arena& operator=(const Arena&) = delete;
+
+			// allocates from the current thread's arena or from the heap if there is none
+			static void* Allocate(size_t size)
+			{
+				size = (size + header + alignment - 1) & ~(alignment - 1);
+				auto arena = Current();
+				char *p;
+
+				if (arena == nullptr)
+				{
+					p = (char*)malloc(size);
+
+					if (p == nullptr)
+					{
+						throw std::bad_alloc();
+					}
+				}
+				else
+				{
+					p = arena->Bump(size);
+				}
+
+				*(Arena**)p = arena;
+				return p + header;
+			}
+
+			// can be called from any thread
+			static void Deallocate(void *p)
+			{
+				if (p == nullptr)
+				{
+					return;
+				}
+
+				auto q = (char*)p - header;
+				auto arena = *(Arena**)q;
+
+				if (arena == nullptr)
+				{
+					free(q);
+				}
+				else
+				{
+					arena->Release();
+				}
+			}
+
+			// makes a new arena current for the calling thread until the scope ends
+			class Scope final
+			{
+				Arena *arena_;
+				Arena *previous_;
+
+			public:
+				Scope(const Scope&) = delete;
+				Scope& operator=(const Scope&) = delete;
+
+				explicit Scope(const size_t blockSize = 256 * 1024)
+					: arena_(new Arena(blockSize))
+					, previous_(Current())
+				{
+					Current() = arena_;
+				}
+
+				~Scope()
+				{
+					Current() = previous_;
+					arena_->Release();
+				}
+
+				size_t Size() const
+				{
+					return arena_->size_;
+				}
+
+				// retires the current arena and starts a new one,
+				// the retired arena is freed as soon as all maves allocated from it are gone
+				void Renew()
+				{
+					auto arena = arena_;
+					Current() = arena_ = new Arena(arena->blockSize_);
+					arena->Release();
+				}
+			};
+		};
+
+		template <typename T>
+		class Allocator
+		{
+		public:
+			typedef T value_type;
+
+			Allocator() {}
+			template <typename U> Allocator(const Allocator<U>&) {}
+
+			T* allocate(const size_t n) { return (T*)Arena::Allocate(n * sizeof(T)); }
+			void deallocate(T *p, const size_t) { Arena::Deallocate(p); }
+
+			template <typename U> bool operator==(const Allocator<U>&) const { return true; }
+			template <typename U> bool operator!=(const Allocator<U>&) const { return false; }
+		};
+	}
+}
\ No newline at end of file
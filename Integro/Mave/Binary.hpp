@@ -0,0 +1,546 @@
+#pragma once
+
+#include <cstring>
+#include <cstdint>
+
+#include <boost/utility/string_ref.hpp>
+
+#include "Mave/Mave.hpp"
+
+namespace Integro
+{
+	namespace Mave
+	{
+		using boost::string_ref;
+
+		// a serialized mave is a header followed by one value
+		//	header			'M' 'B' version
+		//	value			tag payload
+		//	null, bool		no payload, false and true have their own tags
+		//	int, long		zigzag varint
+		//	milliseconds	zigzag varint
+		//	double			8 bytes
+		//	string			varint length, bytes
+		//	custom			16 bytes of uuid, varint length, bytes
+		//	vector			4 bytes of size, varint count, values
+		//	map				4 bytes of size, varint count, (varint key length, key bytes, value) pairs sorted by key
+		// size is the number of bytes that follow it within a vector or map, so readers can skip them
+		// fixed width numbers are little endian
+		const unsigned char BINARY_VERSION = 1;
+
+		// tags are part of the format and must not be renumbered
+		enum BinaryTag
+		{
+			BINARY_NULL = 0
+			, BINARY_FALSE = 1
+			, BINARY_TRUE = 2
+			, BINARY_INT = 3
+			, BINARY_LONG = 4
+			, BINARY_DOUBLE = 5
+			, BINARY_MILLISECONDS = 6
+			, BINARY_STRING = 7
+			, BINARY_CUSTOM = 8
+			, BINARY_VECTOR = 9
+			, BINARY_MAP = 10
+		};
+
+		class BinaryWriter
+		{
+			string &buffer_;
+			vector<size_t> sizes_;
+
+			void WriteTag(const BinaryTag tag) { buffer_ += (char)tag; }
+
+			void WriteVarint(unsigned long long value)
+			{
+				while (value >= 0x80)
+				{
+					buffer_ += (char)(value | 0x80);
+					value >>= 7;
+				}
+				buffer_ += (char)value;
+			}
+
+			void WriteZigZag(const long long value) { WriteVarint(((unsigned long long)value << 1) ^ (unsigned long long)(value >> 63)); }
+
+			void WriteBytes(const string &value)
+			{
+				WriteVarint(value.size());
+				buffer_ += value;
+			}
+
+			// fixed width numbers are written byte by byte so the format does not depend on the host's byte order
+			void WriteFixed(const size_t position, const unsigned long long value, const size_t width)
+			{
+				for (size_t i = 0; i < width; ++i)
+				{
+					buffer_[position + i] = (char)(value >> (8 * i));
+				}
+			}
+
+			void Begin(const BinaryTag tag, const size_t count)
+			{
+				WriteTag(tag);
+				sizes_.push_back(buffer_.size());
+				buffer_.append(4, '\0');
+				WriteVarint(count);
+			}
+
+			void End()
+			{
+				auto position = sizes_.back();
+				auto size = buffer_.size() - position - 4;
+				sizes_.pop_back();
+
+				if (size > UINT32_MAX)
+				{
+					throw exception("Mave::ToBinary(): container is too large");
+				}
+
+				WriteFixed(position, size, 4);
+			}
+
+		public:
+			BinaryWriter(string &buffer) : buffer_(buffer) {}
+
+			void Scalar(const Mave *mave)
+			{
+				switch (mave->GetType())
+				{
+					case MAVE_NULL:
+						WriteTag(BINARY_NULL);
+						break;
+					case MAVE_BOOL:
+						WriteTag(mave->AsBool() ? BINARY_TRUE : BINARY_FALSE);
+						break;
+					case MAVE_INT:
+						WriteTag(BINARY_INT);
+						WriteZigZag(mave->AsInt());
+						break;
+					case MAVE_LONG:
+						WriteTag(BINARY_LONG);
+						WriteZigZag(mave->AsLong());
+						break;
+					case MAVE_DOUBLE:
+					{
+						auto value = mave->AsDouble();
+						uint64_t bits;
+						memcpy(&bits, &value, 8);
+						WriteTag(BINARY_DOUBLE);
+						buffer_.append(8, '\0');
+						WriteFixed(buffer_.size() - 8, bits, 8);
+						break;
+					}
+					case MAVE_MILLISECONDS:
+						WriteTag(BINARY_MILLISECONDS);
+						WriteZigZag(mave->AsMilliseconds().count());
+						break;
+					case MAVE_STRING:
+						WriteTag(BINARY_STRING);
+						WriteBytes(mave->AsString());
+						break;
+					case MAVE_CUSTOM:
+						WriteTag(BINARY_CUSTOM);
+						buffer_.append((const char*)mave->AsCustom().first.data, 16);
+						WriteBytes(mave->AsCustom().second);
+						break;
+					default:
+						throw exception("Mave::ToBinary(): unsupported type encountered");
+				}
+			}
+
+			void BeginMap(const Mave *mave) { Begin(BINARY_MAP, mave->AsMap().size()); }
+			void Field(const Key &key, bool) { WriteBytes(key.AsString()); }
+			void EndMap() { End(); }
+			void BeginVector(const Mave *mave) { Begin(BINARY_VECTOR, mave->AsVector().size()); }
+			void Item(bool) {}
+			void EndVector() { End(); }
+		};
+
+		// appends a serialized mave to buffer
+		void ToBinary(const Mave &root, string &buffer)
+		{
+			buffer += 'M';
+			buffer += 'B';
+			buffer += (char)BINARY_VERSION;
+
+			BinaryWriter writer(buffer);
+			Walk<MaveSource>(&root, writer);
+		}
+
+		string ToBinary(const Mave &root)
+		{
+			string result;
+			ToBinary(root, result);
+			return result;
+		}
+
+		// a value inside a serialized mave, read in place without building a tree,
+		// the buffer must outlive its views
+		class BinaryView
+		{
+			const char *data_;
+			const char *payload_;
+			const char *end_;
+
+			static void Throw()
+			{
+				throw exception("Mave::BinaryView(): malformed binary mave");
+			}
+
+			static unsigned long long ReadVarint(const char *&p, const char *limit)
+			{
+				unsigned long long result = 0;
+
+				for (auto shift = 0; shift < 64; shift += 7)
+				{
+					if (p == limit)
+					{
+						Throw();
+					}
+
+					auto byte = (unsigned char)*p++;
+					result |= (unsigned long long)(byte & 0x7f) << shift;
+
+					if (byte < 0x80)
+					{
+						return result;
+					}
+				}
+
+				Throw();
+				return 0;
+			}
+
+			static unsigned long long ReadFixed(const char *p, const size_t width)
+			{
+				unsigned long long result = 0;
+
+				for (size_t i = 0; i < width; ++i)
+				{
+					result |= (unsigned long long)(unsigned char)p[i] << (8 * i);
+				}
+
+				return result;
+			}
+
+			static long long ReadZigZag(const char *&p, const char *limit)
+			{
+				auto value = ReadVarint(p, limit);
+				return (long long)(value >> 1) ^ -(long long)(value & 1);
+			}
+
+			static string_ref ReadBytes(const char *&p, const char *limit)
+			{
+				auto size = ReadVarint(p, limit);
+
+				if (size > (unsigned long long)(limit - p))
+				{
+					Throw();
+				}
+
+				string_ref result(p, (size_t)size);
+				p += size;
+				return result;
+			}
+
+		public:
+			class Iterator
+			{
+				const char *position_;
+				const char *end_;
+				bool isMap_;
+				string_ref key_;
+				const char *value_;
+				const char *next_;
+
+				void Read()
+				{
+					if (position_ != end_)
+					{
+						auto p = position_;
+
+						if (isMap_)
+						{
+							key_ = ReadBytes(p, end_);
+						}
+
+						value_ = p;
+						next_ = BinaryView(p, end_).end_;
+					}
+				}
+
+			public:
+				Iterator() : position_(nullptr), end_(nullptr), isMap_(false), value_(nullptr), next_(nullptr) {}
+				Iterator(const char *position, const char *end, const bool isMap) : position_(position), end_(end), isMap_(isMap), value_(nullptr), next_(nullptr) { Read(); }
+
+				string_ref Key() const { return key_; }
+				BinaryView Value() const { return BinaryView(value_, next_); }
+
+				Iterator& operator++() { position_ = next_; Read(); return *this; }
+				Iterator operator++(int) { auto result = *this; ++*this; return result; }
+				bool operator==(const Iterator &other) const { return position_ == other.position_; }
+				bool operator!=(const Iterator &other) const { return position_ != other.position_; }
+			};
+
+			BinaryView() : data_(nullptr), payload_(nullptr), end_(nullptr) {}
+
+			// reads the value that starts at data and must end before limit
+			BinaryView(const char *data, const char *limit) : data_(data), payload_(data + 1)
+			{
+				if (data >= limit)
+				{
+					Throw();
+				}
+
+				auto p = payload_;
+
+				switch ((unsigned char)*data)
+				{
+					case BINARY_NULL:
+					case BINARY_FALSE:
+					case BINARY_TRUE:
+						break;
+					case BINARY_INT:
+					case BINARY_LONG:
+					case BINARY_MILLISECONDS:
+						ReadVarint(p, limit);
+						break;
+					case BINARY_DOUBLE:
+						if (limit - p < 8)
+						{
+							Throw();
+						}
+						p += 8;
+						break;
+					case BINARY_STRING:
+						ReadBytes(p, limit);
+						break;
+					case BINARY_CUSTOM:
+						if (limit - p < 16)
+						{
+							Throw();
+						}
+						p += 16;
+						ReadBytes(p, limit);
+						break;
+					case BINARY_VECTOR:
+					case BINARY_MAP:
+					{
+						if (limit - p < 4)
+						{
+							Throw();
+						}
+
+						auto size = (uint32_t)ReadFixed(p, 4);
+						p += 4;
+						payload_ = p;
+
+						if (size > (size_t)(limit - p))
+						{
+							Throw();
+						}
+
+						p += size;
+						break;
+					}
+					default:
+						Throw();
+				}
+
+				end_ = p;
+			}
+
+			// reads a whole serialized mave, checking its header
+			static BinaryView Parse(const char *data, const size_t size)
+			{
+				if (size < 3 || data[0] != 'M' || data[1] != 'B')
+				{
+					Throw();
+				}
+
+				if ((unsigned char)data[2] != BINARY_VERSION)
+				{
+					throw exception("Mave::BinaryView::Parse(): unsupported binary mave version");
+				}
+
+				BinaryView result(data + 3, data + size);
+
+				if (result.end_ != data + size)
+				{
+					Throw();
+				}
+
+				return result;
+			}
+
+			static BinaryView Parse(const string &data) { return Parse(data.data(), data.size()); }
+
+			MaveType GetType() const
+			{
+				switch ((unsigned char)*data_)
+				{
+					case BINARY_FALSE: case BINARY_TRUE: return MAVE_BOOL;
+					case BINARY_INT: return MAVE_INT;
+					case BINARY_LONG: return MAVE_LONG;
+					case BINARY_DOUBLE: return MAVE_DOUBLE;
+					case BINARY_MILLISECONDS: return MAVE_MILLISECONDS;
+					case BINARY_STRING: return MAVE_STRING;
+					case BINARY_CUSTOM: return MAVE_CUSTOM;
+					case BINARY_VECTOR: return MAVE_VECTOR;
+					case BINARY_MAP: return MAVE_MAP;
+					default: return MAVE_NULL;
+				}
+			}
+
+			bool HasType(const MaveType type) const { return type == GetType(); }
+			void Assert(const MaveType type) const {
+				if (!HasType(type)) {
+					throw exception("Mave::BinaryView::Assert(): invalid type");
+				}
+			}
+
+			// the serialized bytes of this value
+			string_ref Bytes() const { return string_ref(data_, end_ - data_); }
+
+			bool IsNull() const { return HasType(MAVE_NULL); }
+			bool IsBool() const { return HasType(MAVE_BOOL); }
+			bool AsBool() const { Assert(MAVE_BOOL); return *data_ == BINARY_TRUE; }
+			bool IsInt() const { return HasType(MAVE_INT); }
+			int AsInt() const { Assert(MAVE_INT); auto p = payload_; return (int)ReadZigZag(p, end_); }
+			bool IsLong() const { return HasType(MAVE_LONG); }
+			long long AsLong() const { Assert(MAVE_LONG); auto p = payload_; return ReadZigZag(p, end_); }
+			bool IsDouble() const { return HasType(MAVE_DOUBLE); }
+			double AsDouble() const { Assert(MAVE_DOUBLE); auto bits = (uint64_t)ReadFixed(payload_, 8); double result; memcpy(&result, &bits, 8); return result; }
+			bool IsMilliseconds() const { return HasType(MAVE_MILLISECONDS); }
+			milliseconds AsMilliseconds() const { Assert(MAVE_MILLISECONDS); auto p = payload_; return milliseconds(ReadZigZag(p, end_)); }
+			bool IsString() const { return HasType(MAVE_STRING); }
+			string_ref AsString() const { Assert(MAVE_STRING); auto p = payload_; return ReadBytes(p, end_); }
+			bool IsCustom() const { return HasType(MAVE_CUSTOM); }
+			uuid CustomId() const { Assert(MAVE_CUSTOM); uuid result; memcpy(result.data, payload_, 16); return result; }
+			string_ref CustomValue() const { Assert(MAVE_CUSTOM); auto p = payload_ + 16; return ReadBytes(p, end_); }
+			bool IsVector() const { return HasType(MAVE_VECTOR); }
+			bool IsMap() const { return HasType(MAVE_MAP); }
+
+			// the number of items in a vector or map
+			size_t Size() const
+			{
+				if (!IsVector() && !IsMap())
+				{
+					throw exception("Mave::BinaryView::Size(): invalid type");
+				}
+				auto p = payload_;
+				return (size_t)ReadVarint(p, end_);
+			}
+
+			Iterator begin() const
+			{
+				auto p = payload_;
+				Size();
+				ReadVarint(p, end_);
+				return Iterator(p, end_, IsMap());
+			}
+
+			Iterator end() const { return Iterator(end_, end_, IsMap()); }
+
+			// finds an item by index or key, scanning and skipping serialized values
+			BinaryView operator[](size_t index) const
+			{
+				Assert(MAVE_VECTOR);
+				for (auto i = begin(), e = end(); i != e; ++i, --index)
+				{
+					if (index == 0)
+					{
+						return i.Value();
+					}
+				}
+				throw exception("Mave::BinaryView::operator[](): index out of range");
+			}
+
+			BinaryView operator[](const string &key) const
+			{
+				Assert(MAVE_MAP);
+				for (auto i = begin(), e = end(); i != e; ++i)
+				{
+					if (i.Key() == key)
+					{
+						return i.Value();
+					}
+				}
+				throw exception("Mave::BinaryView::operator[](): key not found");
+			}
+		};
+
+		struct BinarySource
+		{
+			typedef BinaryView Node;
+			typedef BinaryView::Iterator MapIterator;
+			typedef BinaryView::Iterator VectorIterator;
+
+			static WalkKind Kind(const Node &node) { return node.IsMap() ? WALK_MAP : node.IsVector() ? WALK_VECTOR : WALK_SCALAR; }
+			static MapIterator MapBegin(const Node &node) { return node.begin(); }
+			static MapIterator MapEnd(const Node &node) { return node.end(); }
+			static VectorIterator VectorBegin(const Node &node) { return node.begin(); }
+			static VectorIterator VectorEnd(const Node &node) { return node.end(); }
+			static string_ref MapKey(const MapIterator &i) { return i.Key(); }
+			static Node MapValue(const MapIterator &i) { return i.Value(); }
+			static Node VectorValue(const VectorIterator &i) { return i.Value(); }
+		};
+
+		class BinaryReader : public Builder
+		{
+		public:
+			void Scalar(const BinaryView &view)
+			{
+				switch (view.GetType())
+				{
+					case MAVE_NULL:
+						Add(nullptr);
+						break;
+					case MAVE_BOOL:
+						Add(view.AsBool());
+						break;
+					case MAVE_INT:
+						Add(view.AsInt());
+						break;
+					case MAVE_LONG:
+						Add(view.AsLong());
+						break;
+					case MAVE_DOUBLE:
+						Add(view.AsDouble());
+						break;
+					case MAVE_MILLISECONDS:
+						Add(view.AsMilliseconds());
+						break;
+					case MAVE_STRING:
+						Add(view.AsString().to_string());
+						break;
+					case MAVE_CUSTOM:
+						Add(make_pair(view.CustomId(), view.CustomValue().to_string()));
+						break;
+					default:
+						throw exception("Mave::FromBinary(): unsupported type encountered");
+				}
+			}
+
+			void Field(string_ref key, bool first) { Builder::Field(key.to_string(), first); }
+		};
+
+		Mave FromBinary(const BinaryView &view)
+		{
+			BinaryReader reader;
+			Walk<BinarySource>(view, reader);
+			return move(reader.Result());
+		}
+
+		Mave FromBinary(const char *data, const size_t size)
+		{
+			return FromBinary(BinaryView::Parse(data, size));
+		}
+
+		Mave FromBinary(const string &data)
+		{
+			return FromBinary(data.data(), data.size());
+		}
+	}
+}
\ No newline at end of file
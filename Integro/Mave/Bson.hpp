@@ -1,6 +1,7 @@
 #pragma once
 
 #include "Mave/Mave.hpp"
+#include "Mave/Json.hpp"
 
 #include "bsoncxx/builder/core.hpp"
 #include "bsoncxx/builder/stream/document.hpp"
@@ -16,128 +17,96 @@ namespace Integro
 	{
 		auto BSON_OID = string_generator()("389da9dd-4e9f-4b80-984c-331fe6ab0df1");
 
-		Mave FromBson(bsoncxx::types::value bson)
+		struct BsonSource
 		{
-			Mave result;
-			vector<function<bool()>> continuations;
-			auto root = bson;
+			typedef bsoncxx::types::value Node;
+			typedef bsoncxx::document::view::const_iterator MapIterator;
+			typedef bsoncxx::array::view::const_iterator VectorIterator;
+
+			static WalkKind Kind(const Node &node) { return node.type() == bsoncxx::type::k_document ? WALK_MAP : node.type() == bsoncxx::type::k_array ? WALK_VECTOR : WALK_SCALAR; }
+			static MapIterator MapBegin(const Node &node) { return node.get_document().value.cbegin(); }
+			static MapIterator MapEnd(const Node &node) { return node.get_document().value.cend(); }
+			static VectorIterator VectorBegin(const Node &node) { return node.get_array().value.cbegin(); }
+			static VectorIterator VectorEnd(const Node &node) { return node.get_array().value.cend(); }
+			static bsoncxx::stdx::string_view MapKey(MapIterator i) { return i->key(); }
+			static Node MapValue(MapIterator i) { return i->get_value(); }
+			static Node VectorValue(VectorIterator i) { return i->get_value(); }
+		};
 
-			while (true)
+		class BsonReader : public Builder
+		{
+		public:
+			void Scalar(const bsoncxx::types::value &bson)
 			{
 				switch (bson.type())
 				{
 					case bsoncxx::type::k_undefined:
 					case bsoncxx::type::k_minkey:
 					case bsoncxx::type::k_maxkey:
-						break;
 					case bsoncxx::type::k_null:
-						result = nullptr;
+						Add(nullptr);
 						break;
 					case bsoncxx::type::k_bool:
-						result = bson.get_bool().value;
+						Add(bson.get_bool().value);
 						break;
 					case bsoncxx::type::k_int32:
-						result = bson.get_int32().value;
+						Add(bson.get_int32().value);
 						break;
 					case bsoncxx::type::k_int64:
-						result = bson.get_int64().value;
+						Add(bson.get_int64().value);
 						break;
 					case bsoncxx::type::k_double:
-						result = bson.get_double().value;
+						Add(bson.get_double().value);
 						break;
 					case bsoncxx::type::k_date:
-						result = milliseconds(bson.get_date().value);
+						Add(milliseconds(bson.get_date().value));
 						break;
 					case bsoncxx::type::k_utf8:
-						result = bson.get_utf8().value.to_string();
+						Add(bson.get_utf8().value.to_string());
 						break;
 					case bsoncxx::type::k_oid:
-						result = make_pair(BSON_OID, bson.get_oid().value.to_string());
+						Add(make_pair(BSON_OID, bson.get_oid().value.to_string()));
 						break;
 					case bsoncxx::type::k_dbpointer:
-						result = make_pair(BSON_OID, bson.get_dbpointer().value.to_string());
+						Add(make_pair(BSON_OID, bson.get_dbpointer().value.to_string()));
 						break;
 					case bsoncxx::type::k_timestamp:
+					{
 						auto t = bson.get_timestamp();
-						result = (long)(((unsigned long long)t.timestamp << 32) | t.increment);
+						Add((long long)(((unsigned long long)t.timestamp << 32) | t.increment));
 						break;
+					}
 					case bsoncxx::type::k_binary:
+					{
 						auto b = bson.get_binary();
-						result = string((const char*)b.bytes, b.size);
+						Add(string((const char*)b.bytes, b.size));
 						break;
+					}
 					case bsoncxx::type::k_regex:
-						result = bson.get_regex().regex.to_string();
+						Add(bson.get_regex().regex.to_string());
 						break;
 					case bsoncxx::type::k_symbol:
-						result = bson.get_symbol().symbol.to_string();
+						Add(bson.get_symbol().symbol.to_string());
 						break;
 					case bsoncxx::type::k_code:
-						result = bson.get_code().code.to_string();
+						Add(bson.get_code().code.to_string());
 						break;
 					case bsoncxx::type::k_codewscope:
-						result = bson.get_codewscope().code.to_string();
-						break;
-					case bsoncxx::type::k_document:
-						continuations.push_back(
-							[&
-							, m = map<string, Mave>()
-							, i = bson.get_document().value.cbegin()
-							, e = bson.get_document().value.cend()
-							, f = false]() mutable -> bool
-						{
-							if (f)
-							{
-								m.insert({ i->key().to_string(), result });
-								++i;
-							}
-							if (i != e)
-							{
-								bson = i->get_value();
-								return f = true;
-							}
-							result = move(m);
-							return false;
-						});
-						break;
-					case bsoncxx::type::k_array:
-						continuations.push_back(
-							[&
-							, v = vector<Mave>()
-							, i = bson.get_array().value.cbegin()
-							, e = bson.get_array().value.cend()
-							, f = false]() mutable -> bool
-						{
-							if (f)
-							{
-								v.push_back(result);
-								++i;
-							}
-							if (i != e)
-							{
-								bson = i->get_value();
-								return f = true;
-							}
-							result = move(v);
-							return false;
-						});
+						Add(bson.get_codewscope().code.to_string());
 						break;
 					default:
 						throw exception("Mave::FromBson(): unsupported type encountered");
 				}
-
-				while (true)
-				{
-					if (continuations.size() == 0)
-					{
-						return result;
-					}
-					if (continuations.back()())
-					{
-						break;
-					}
-					continuations.pop_back();
-				}
 			}
+
+			void Field(bsoncxx::stdx::string_view key, bool first) { Builder::Field(key.to_string(), first); }
+		};
+
+		Mave FromBson(bsoncxx::types::value bson)
+		{
+			BsonReader reader;
+			Walk<BsonSource>(bson, reader);
+			return move(reader.Result());
 		}
 
 		Mave FromBson(bsoncxx::document::view bson)
@@ -150,101 +119,188 @@ namespace Integro
 			return FromBson(bsoncxx::types::value{ bsoncxx::types::b_array{ bson } });
 		}
 
-		// private function, use ToBsonArray or ToBsonDocument
-		void ToBson(Mave mave, bsoncxx::builder::core &result)
+		class BsonBuilder
 		{
-			vector<function<bool()>> continuations;
-			auto f = 0;
-			auto root = mave;
+			bsoncxx::builder::core &result_;
+			int depth_;
+
+		public:
+			BsonBuilder(bsoncxx::builder::core &result) : result_(result), depth_(0) {}
 
-			while (true)
+			void Scalar(const Mave *mave)
 			{
-				switch (mave.GetType())
+				switch (mave->GetType())
 				{
 					case MAVE_NULL:
-						result.append(bsoncxx::types::b_null());
+						result_.append(bsoncxx::types::b_null());
 						break;
 					case MAVE_BOOL:
-						result.append(mave.AsBool());
+						result_.append(mave->AsBool());
 						break;
 					case MAVE_INT:
-						result.append(mave.AsInt());
+						result_.append(mave->AsInt());
 						break;
 					case MAVE_LONG:
-						result.append(mave.AsLong());
+						result_.append(mave->AsLong());
 						break;
 					case MAVE_DOUBLE:
-						result.append(mave.AsDouble());
+						result_.append(mave->AsDouble());
 						break;
 					case MAVE_MILLISECONDS:
-						result.append(bsoncxx::types::b_date(mave.AsMilliseconds().count()));
+						result_.append(bsoncxx::types::b_date(mave->AsMilliseconds().count()));
 						break;
 					case MAVE_STRING:
-						result.append(mave.AsString());
+						result_.append(mave->AsString());
 						break;
 					case MAVE_CUSTOM:
-						if (mave.AsCustom().first == BSON_OID)
+						if (mave->AsCustom().first == BSON_OID)
 						{
-							result.append(bsoncxx::oid(mave.AsCustom().second));
+							result_.append(bsoncxx::oid(mave->AsCustom().second));
 						}
 						else
 						{
-							result.append(mave.AsCustom().second);
+							result_.append(mave->AsCustom().second);
 						}
 						break;
-					case MAVE_MAP:
-						if (f++ > 0) result.open_document();
-						continuations.push_back(
-							[&
-							, i = mave.AsMap().cbegin()
-							, e = mave.AsMap().cend()]() mutable -> bool
-						{
-							if (i != e)
-							{
-								result.key_view(i->first);
-								mave = i++->second;
-								return true;
-							}
-							if (--f > 0) result.close_document();
-							return false;
-						});
-						break;
-					case MAVE_VECTOR:
-						if (f++ > 0) result.open_array();
-						continuations.push_back(
-							[&
-							, i = mave.AsVector().cbegin()
-							, e = mave.AsVector().cend()]() mutable -> bool
-						{
-							if (i != e)
-							{
-								mave = *i++;
-								return true;
-							}
-							if (--f > 0) result.close_array();
-							return false;
-						});
-						break;
 					default:
 						throw exception("Mave::ToBson(): unsupported type encountered");
 				}
+			}
+
+			void BeginMap(const Mave*) { if (depth_++ > 0) result_.open_document(); }
+			void Field(const Key &key, bool) { result_.key_view(key.AsString()); }
+			void EndMap() { if (--depth_ > 0) result_.close_document(); }
+			void BeginVector(const Mave*) { if (depth_++ > 0) result_.open_array(); }
+			void Item(bool) {}
+			void EndVector() { if (--depth_ > 0) result_.close_array(); }
+		};
+
+		// private function, use ToBsonArray or ToBsonDocument
+		void ToBson(const Mave &root, bsoncxx::builder::core &result)
+		{
+			BsonBuilder builder(result);
+			Walk<MaveSource>(&root, builder);
+		}
+
+		// transcodes bson straight to json text, converting values as FromBson followed by ToJson would,
+		// fields keep their bson order instead of being sorted by key
+		class BsonJsonWriter
+		{
+			string &buffer_;
+
+			static void WriteString(bsoncxx::stdx::string_view value, string &buffer)
+			{
+				JsonWriter::WriteString(value.data(), value.size(), buffer);
+			}
 
-				while (true)
+		public:
+			BsonJsonWriter(string &buffer) : buffer_(buffer) {}
+
+			// returns true if a value of type is written as a json string
+			static bool IsString(const bsoncxx::type type)
+			{
+				switch (type)
 				{
-					if (continuations.size() == 0)
+					case bsoncxx::type::k_int64:
+					case bsoncxx::type::k_date:
+					case bsoncxx::type::k_utf8:
+					case bsoncxx::type::k_oid:
+					case bsoncxx::type::k_dbpointer:
+					case bsoncxx::type::k_timestamp:
+					case bsoncxx::type::k_binary:
+					case bsoncxx::type::k_regex:
+					case bsoncxx::type::k_symbol:
+					case bsoncxx::type::k_code:
+					case bsoncxx::type::k_codewscope:
+						return true;
+					default:
+						return false;
+				}
+			}
+
+			void Scalar(const bsoncxx::types::value &bson)
+			{
+				switch (bson.type())
+				{
+					case bsoncxx::type::k_undefined:
+					case bsoncxx::type::k_minkey:
+					case bsoncxx::type::k_maxkey:
+					case bsoncxx::type::k_null:
+						buffer_ += "null";
+						break;
+					case bsoncxx::type::k_bool:
+						buffer_ += bson.get_bool().value ? "true" : "false";
+						break;
+					case bsoncxx::type::k_int32:
+						JsonWriter::WriteInt(bson.get_int32().value, buffer_);
+						break;
+					case bsoncxx::type::k_int64:
+						JsonWriter::WriteLong(bson.get_int64().value, buffer_);
+						break;
+					case bsoncxx::type::k_double:
+						JsonWriter::WriteDouble(bson.get_double().value, buffer_);
+						break;
+					case bsoncxx::type::k_date:
+						JsonWriter::WriteMilliseconds(milliseconds(bson.get_date().value), buffer_);
+						break;
+					case bsoncxx::type::k_utf8:
+						WriteString(bson.get_utf8().value, buffer_);
+						break;
+					case bsoncxx::type::k_oid:
+						JsonWriter::WriteString(bson.get_oid().value.to_string(), buffer_);
+						break;
+					case bsoncxx::type::k_dbpointer:
+						JsonWriter::WriteString(bson.get_dbpointer().value.to_string(), buffer_);
+						break;
+					case bsoncxx::type::k_timestamp:
 					{
-						return;
+						auto t = bson.get_timestamp();
+						JsonWriter::WriteLong((long long)(((unsigned long long)t.timestamp << 32) | t.increment), buffer_);
+						break;
 					}
-					if (continuations.back()())
+					case bsoncxx::type::k_binary:
 					{
+						auto b = bson.get_binary();
+						JsonWriter::WriteString((const char*)b.bytes, b.size, buffer_);
 						break;
 					}
-					continuations.pop_back();
+					case bsoncxx::type::k_regex:
+						WriteString(bson.get_regex().regex, buffer_);
+						break;
+					case bsoncxx::type::k_symbol:
+						WriteString(bson.get_symbol().symbol, buffer_);
+						break;
+					case bsoncxx::type::k_code:
+						WriteString(bson.get_code().code, buffer_);
+						break;
+					case bsoncxx::type::k_codewscope:
+						WriteString(bson.get_codewscope().code, buffer_);
+						break;
+					default:
+						throw exception("Mave::ToJson(): unsupported type encountered");
 				}
 			}
+
+			void BeginMap(const bsoncxx::types::value&) { buffer_ += '{'; }
+			void Field(bsoncxx::stdx::string_view key, bool first) { if (!first) buffer_ += ','; WriteString(key, buffer_); buffer_ += ':'; }
+			void EndMap() { buffer_ += '}'; }
+			void BeginVector(const bsoncxx::types::value&) { buffer_ += '['; }
+			void Item(bool first) { if (!first) buffer_ += ','; }
+			void EndVector() { buffer_ += ']'; }
+		};
+
+		void ToJson(bsoncxx::types::value bson, string &buffer)
+		{
+			BsonJsonWriter writer(buffer);
+			Walk<BsonSource>(bson, writer);
+		}
+
+		void ToJson(bsoncxx::document::view bson, string &buffer)
+		{
+			ToJson(bsoncxx::types::value{ bsoncxx::types::b_document{ bson } }, buffer);
 		}
 
-		bsoncxx::array::value ToBsonArray(Mave mave)
+		bsoncxx::array::value ToBsonArray(const Mave &mave)
 		{
 			if (!mave.IsVector())
 			{
@@ -255,7 +311,7 @@ namespace Integro
 			return result.extract_array();
 		}
 
-		bsoncxx::document::value ToBsonDocument(Mave mave)
+		bsoncxx::document::value ToBsonDocument(const Mave &mave)
 		{
 			if (!mave.IsMap())
 			{
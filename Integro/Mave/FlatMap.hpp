@@ -0,0 +1,155 @@
+#pragma once
+
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <initializer_list>
+
+namespace Integro
+{
+	namespace Mave
+	{
+		// a map stored as a vector of key/value pairs sorted by key,
+		// lookups are binary searches over contiguous memory and there is one allocation per map,
+		// meant for documents of tens of fields, inserting into the middle moves the tail
+		template <typename K, typename V, typename A = std::allocator<std::pair<K, V>>>
+		class FlatMap
+		{
+		public:
+			typedef K key_type;
+			typedef V mapped_type;
+			typedef std::pair<K, V> value_type;
+			typedef std::vector<value_type, A> container_type;
+			typedef typename container_type::size_type size_type;
+			typedef typename container_type::iterator iterator;
+			typedef typename container_type::const_iterator const_iterator;
+
+		private:
+			container_type items_;
+
+			struct Less
+			{
+				template <typename T>
+				bool operator()(const value_type &item, const T &key) const { return item.first < key; }
+			};
+
+			template <typename T>
+			iterator LowerBound(const T &key)
+			{
+				// documents built from sorted sources append, so try the end first
+				if (items_.empty() || items_.back().first < key)
+				{
+					return items_.end();
+				}
+				return std::lower_bound(items_.begin(), items_.end(), key, Less());
+			}
+
+			template <typename T>
+			const_iterator LowerBound(const T &key) const
+			{
+				return std::lower_bound(items_.begin(), items_.end(), key, Less());
+			}
+
+			template <typename T>
+			static bool Matches(const value_type &item, const T &key) { return !(key < item.first); }
+
+		public:
+			FlatMap() {}
+
+			template <typename I>
+			FlatMap(I first, I last)
+			{
+				for (; first != last; ++first)
+				{
+					insert(value_type(first->first, first->second));
+				}
+			}
+
+			FlatMap(std::initializer_list<value_type> items)
+			{
+				items_.reserve(items.size());
+
+				for (auto &item : items)
+				{
+					insert(item);
+				}
+			}
+
+			iterator begin() { return items_.begin(); }
+			iterator end() { return items_.end(); }
+			const_iterator begin() const { return items_.begin(); }
+			const_iterator end() const { return items_.end(); }
+			const_iterator cbegin() const { return items_.cbegin(); }
+			const_iterator cend() const { return items_.cend(); }
+
+			bool empty() const { return items_.empty(); }
+			size_type size() const { return items_.size(); }
+			void reserve(const size_type n) { items_.reserve(n); }
+			void clear() { items_.clear(); }
+
+			template <typename T>
+			iterator find(const T &key)
+			{
+				auto i = LowerBound(key);
+				return i != items_.end() && Matches(*i, key) ? i : items_.end();
+			}
+
+			template <typename T>
+			const_iterator find(const T &key) const
+			{
+				auto i = LowerBound(key);
+				return i != items_.end() && Matches(*i, key) ? i : items_.end();
+			}
+
+			template <typename T>
+			size_type count(const T &key) const { return find(key) == items_.end() ? 0 : 1; }
+
+			// like std::map, an existing key keeps its value
+			std::pair<iterator, bool> insert(const value_type &item)
+			{
+				auto i = LowerBound(item.first);
+				if (i != items_.end() && Matches(*i, item.first))
+				{
+					return{ i, false };
+				}
+				return{ items_.insert(i, item), true };
+			}
+
+			std::pair<iterator, bool> insert(value_type &&item)
+			{
+				auto i = LowerBound(item.first);
+				if (i != items_.end() && Matches(*i, item.first))
+				{
+					return{ i, false };
+				}
+				return{ items_.insert(i, std::move(item)), true };
+			}
+
+			template <typename T>
+			V& operator[](const T &key)
+			{
+				auto i = LowerBound(key);
+				if (i == items_.end() || !Matches(*i, key))
+				{
+					i = items_.insert(i, value_type(K(key), V()));
+				}
+				return i->second;
+			}
+
+			iterator erase(iterator position) { return items_.erase(position); }
+			iterator erase(const_iterator position) { return items_.erase(position); }
+
+			template <typename T>
+			size_type erase(const T &key)
+			{
+				auto i = find(key);
+				if (i == items_.end())
+				{
+					return 0;
+				}
+				items_.erase(i);
+				return 1;
+			}
+		};
+	}
+}
\ No newline at end of file
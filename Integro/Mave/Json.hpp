@@ -2,6 +2,9 @@
 
 #include "Mave/Mave.hpp"
 
+#include <cstdio>
+#include <cmath>
+
 #include "json11.hxx"
 
 namespace Integro
@@ -10,186 +13,281 @@ namespace Integro
 	{
 		using std::to_string;
 
-		Mave FromJson(json11::Json json)
+		struct JsonSource
 		{
-			Mave result;
-			vector<function<bool()>> continuations;
-			auto root = json;
+			typedef const json11::Json *Node;
+			typedef json11::Json::object::const_iterator MapIterator;
+			typedef json11::Json::array::const_iterator VectorIterator;
 
-			while (true)
+			static WalkKind Kind(Node node) { return node->is_object() ? WALK_MAP : node->is_array() ? WALK_VECTOR : WALK_SCALAR; }
+			static MapIterator MapBegin(Node node) { return node->object_items().cbegin(); }
+			static MapIterator MapEnd(Node node) { return node->object_items().cend(); }
+			static VectorIterator VectorBegin(Node node) { return node->array_items().cbegin(); }
+			static VectorIterator VectorEnd(Node node) { return node->array_items().cend(); }
+			static const string& MapKey(MapIterator i) { return i->first; }
+			static Node MapValue(MapIterator i) { return &i->second; }
+			static Node VectorValue(VectorIterator i) { return &*i; }
+		};
+
+		class JsonReader : public Builder
+		{
+		public:
+			void Scalar(const json11::Json *json)
 			{
-				switch (json.type())
+				switch (json->type())
 				{
 					case json11::Json::NUL:
-						result = nullptr;
+						Add(nullptr);
 						break;
 					case json11::Json::BOOL:
-						result = json.bool_value();
+						Add(json->bool_value());
 						break;
 					case json11::Json::NUMBER:
-						result = json.number_value();
+						Add(json->number_value());
 						break;
 					case json11::Json::STRING:
-						result = json.string_value();
-						break;
-					case json11::Json::OBJECT:
-						continuations.push_back(
-							[&
-							, m = map<string, Mave>()
-							, i = json.object_items().cbegin()
-							, e = json.object_items().cend()
-							, f = false]() mutable -> bool
-						{
-							if (f)
-							{
-								m.insert({ i->first, result });
-								++i;
-							}
-							if (i != e)
-							{
-								json = i->second;
-								return f = true;
-							}
-							result = move(m);
-							return false;
-						});
-						break;
-					case json11::Json::ARRAY:
-						continuations.push_back(
-							[&
-							, v = vector<Mave>()
-							, i = json.array_items().cbegin()
-							, e = json.array_items().cend()
-							, f = false]() mutable -> bool
-						{
-							if (f)
-							{
-								v.push_back(result);
-								++i;
-							}
-							if (i != e)
-							{
-								json = *i;
-								return f = true;
-							}
-							result = move(v);
-							return false;
-						});
+						Add(json->string_value());
 						break;
 					default:
 						throw exception("Mave::FromJson(): unsupported type encountered");
 				}
-
-				while (true)
-				{
-					if (continuations.size() == 0)
-					{
-						return result;
-					}
-					if (continuations.back()())
-					{
-						break;
-					}
-					continuations.pop_back();
-				}
 			}
+		};
+
+		Mave FromJson(json11::Json json)
+		{
+			JsonReader reader;
+			Walk<JsonSource>(&json, reader);
+			return move(reader.Result());
 		}
 
-		json11::Json ToJson(Mave mave)
+		class JsonBuilder
 		{
-			json11::Json result;
-			vector<function<bool()>> continuations;
-			auto root = mave;
+			struct Frame
+			{
+				bool isMap;
+				json11::Json::object object;
+				json11::Json::array array;
+				string key;
+			};
+
+			vector<Frame> frames_;
+			json11::Json result_;
+
+			void Add(json11::Json &&value)
+			{
+				if (frames_.empty())
+				{
+					result_ = move(value);
+				}
+				else if (frames_.back().isMap)
+				{
+					frames_.back().object.insert({ move(frames_.back().key), move(value) });
+				}
+				else
+				{
+					frames_.back().array.push_back(move(value));
+				}
+			}
 
-			while (true)
+		public:
+			void Scalar(const Mave *mave)
 			{
-				switch (mave.GetType())
+				switch (mave->GetType())
 				{
 					case MAVE_NULL:
-						result = nullptr;
+						Add(nullptr);
 						break;
 					case MAVE_BOOL:
-						result = mave.AsBool();
+						Add(mave->AsBool());
 						break;
 					case MAVE_INT:
-						result = mave.AsInt();
+						Add(mave->AsInt());
 						break;
 					case MAVE_LONG:
-						result = to_string(mave.AsLong());
+						Add(to_string(mave->AsLong()));
 						break;
 					case MAVE_DOUBLE:
-						result = mave.AsDouble();
+						Add(mave->AsDouble());
 						break;
 					case MAVE_MILLISECONDS:
-						result = Milliseconds::ToUtc(mave.AsMilliseconds(), true);
+						Add(Milliseconds::ToUtc(mave->AsMilliseconds(), true));
 						break;
 					case MAVE_STRING:
-						result = mave.AsString();
+						Add(mave->AsString());
 						break;
 					case MAVE_CUSTOM:
-						result = mave.AsCustom().second;
-						break;
-					case MAVE_MAP:
-						continuations.push_back(
-							[&
-							, m = json11::Json::object()
-							, i = mave.AsMap().cbegin()
-							, e = mave.AsMap().cend()
-							, f = false]() mutable -> bool
-						{
-							if (f)
-							{
-								m.insert({ i->first, result });
-								++i;
-							}
-							if (i != e)
-							{
-								mave = i->second;
-								return f = true;
-							}
-							result = move(m);
-							return false;
-						});
-						break;
-					case MAVE_VECTOR:
-						continuations.push_back(
-							[&
-							, v = json11::Json::array()
-							, i = mave.AsVector().cbegin()
-							, e = mave.AsVector().cend()
-							, f = false]() mutable -> bool
-						{
-							if (f)
-							{
-								v.push_back(result);
-								++i;
-							}
-							if (i != e)
-							{
-								mave = *i;
-								return f = true;
-							}
-							result = move(v);
-							return false;
-						});
+						Add(mave->AsCustom().second);
 						break;
 					default:
 						throw exception("Mave::ToJson(): unsupported type encountered");
 				}
+			}
+
+			void BeginMap(const Mave*) { frames_.emplace_back(); frames_.back().isMap = true; }
+			void Field(const Key &key, bool) { frames_.back().key = key.AsString(); }
+			void EndMap() { auto object = move(frames_.back().object); frames_.pop_back(); Add(move(object)); }
+			void BeginVector(const Mave*) { frames_.emplace_back(); frames_.back().isMap = false; }
+			void Item(bool) {}
+			void EndVector() { auto array = move(frames_.back().array); frames_.pop_back(); Add(move(array)); }
+
+			json11::Json& Result() { return result_; }
+		};
+
+		json11::Json ToJson(const Mave &root)
+		{
+			JsonBuilder builder;
+			Walk<MaveSource>(&root, builder);
+			return move(builder.Result());
+		}
+
+		// writes json text straight into a buffer, with the same conversions and escaping as ToJson and json11
+		class JsonWriter
+		{
+			string &buffer_;
+
+		public:
+			JsonWriter(string &buffer) : buffer_(buffer) {}
+
+			static void WriteString(const char *data, const size_t size, string &buffer)
+			{
+				static const char hex[] = "0123456789abcdef";
+				size_t run = 0;
+
+				buffer += '"';
 
-				while (true)
+				for (size_t i = 0; i < size; ++i)
 				{
-					if (continuations.size() == 0)
+					auto c = (unsigned char)data[i];
+					const char *escape = nullptr;
+					char unicode[7] = "\\u00";
+					auto skip = 0;
+
+					switch (c)
 					{
-						return result;
+						case '"': escape = "\\\""; break;
+						case '\\': escape = "\\\\"; break;
+						case '\b': escape = "\\b"; break;
+						case '\f': escape = "\\f"; break;
+						case '\n': escape = "\\n"; break;
+						case '\r': escape = "\\r"; break;
+						case '\t': escape = "\\t"; break;
+						case 0xe2:
+							// json11 escapes line and paragraph separators
+							if (i + 2 < size && (unsigned char)data[i + 1] == 0x80 && ((unsigned char)data[i + 2] == 0xa8 || (unsigned char)data[i + 2] == 0xa9))
+							{
+								escape = (unsigned char)data[i + 2] == 0xa8 ? "\\u2028" : "\\u2029";
+								skip = 2;
+							}
+							break;
+						default:
+							if (c <= 0x1f)
+							{
+								unicode[4] = hex[c >> 4];
+								unicode[5] = hex[c & 0xf];
+								escape = unicode;
+							}
+							break;
 					}
-					if (continuations.back()())
+
+					if (escape != nullptr)
 					{
-						break;
+						buffer.append(data + run, i - run);
+						buffer += escape;
+						i += skip;
+						run = i + 1;
 					}
-					continuations.pop_back();
+				}
+
+				buffer.append(data + run, size - run);
+				buffer += '"';
+			}
+
+			static void WriteString(const string &value, string &buffer)
+			{
+				WriteString(value.data(), value.size(), buffer);
+			}
+
+			static void WriteInt(const int value, string &buffer)
+			{
+				char number[16];
+				buffer.append(number, snprintf(number, sizeof(number), "%d", value));
+			}
+
+			// longs are written as strings
+			static void WriteLong(const long long value, string &buffer)
+			{
+				char number[32];
+				buffer += '"';
+				buffer.append(number, snprintf(number, sizeof(number), "%lld", value));
+				buffer += '"';
+			}
+
+			static void WriteDouble(const double value, string &buffer)
+			{
+				char number[32];
+
+				if (std::isfinite(value))
+				{
+					buffer.append(number, snprintf(number, sizeof(number), "%.17g", value));
+				}
+				else
+				{
+					buffer += "null";
+				}
+			}
+
+			static void WriteMilliseconds(const milliseconds value, string &buffer)
+			{
+				WriteString(Milliseconds::ToUtc(value, true), buffer);
+			}
+
+			void Scalar(const Mave *mave)
+			{
+				switch (mave->GetType())
+				{
+					case MAVE_NULL:
+						buffer_ += "null";
+						break;
+					case MAVE_BOOL:
+						buffer_ += mave->AsBool() ? "true" : "false";
+						break;
+					case MAVE_INT:
+						WriteInt(mave->AsInt(), buffer_);
+						break;
+					case MAVE_LONG:
+						WriteLong(mave->AsLong(), buffer_);
+						break;
+					case MAVE_DOUBLE:
+						WriteDouble(mave->AsDouble(), buffer_);
+						break;
+					case MAVE_MILLISECONDS:
+						WriteMilliseconds(mave->AsMilliseconds(), buffer_);
+						break;
+					case MAVE_STRING:
+						WriteString(mave->AsString(), buffer_);
+						break;
+					case MAVE_CUSTOM:
+						WriteString(mave->AsCustom().second, buffer_);
+						break;
+					default:
+						throw exception("Mave::ToJson(): unsupported type encountered");
 				}
 			}
+
+			void BeginMap(const Mave*) { buffer_ += '{'; }
+			void Field(const Key &key, bool first) { if (!first) buffer_ += ','; WriteString(key.AsString(), buffer_); buffer_ += ':'; }
+			void EndMap() { buffer_ += '}'; }
+			void BeginVector(const Mave*) { buffer_ += '['; }
+			void Item(bool first) { if (!first) buffer_ += ','; }
+			void EndVector() { buffer_ += ']'; }
+		};
+
+		// appends json text to buffer without building a json11 value
+		void ToJson(const Mave &root, string &buffer)
+		{
+			JsonWriter writer(buffer);
+			Walk<MaveSource>(&root, writer);
 		}
 	}
 }
\ No newline at end of file
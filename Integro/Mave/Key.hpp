@@ -0,0 +1,105 @@
+#pragma once
+
+#include <string>
+#include <unordered_set>
+#include <memory>
+#include <shared_mutex>
+#include <mutex>
+#include <ostream>
+
+namespace Integro
+{
+	namespace Mave
+	{
+		using std::string;
+
+		// an interned string, equal keys share one process-wide copy and are compared by pointer,
+		// interned keys are never freed, so the table is capped and keys beyond the cap own their string,
+		// such keys are freed with the last map that holds them and are compared by value
+		class Key final
+		{
+			struct Table
+			{
+				std::shared_timed_mutex lock;
+				std::unordered_set<string> strings;
+			};
+
+			static const size_t tableCount = 16;
+			// attribute names and configuration constants fit well below the cap
+			static const size_t maxTableSize = 4096;
+
+			const string *value_;
+			std::shared_ptr<const string> owned_;
+
+			static const string& Empty()
+			{
+				static const string empty;
+				return empty;
+			}
+
+			// returns nullptr if the string is not interned and its table is full
+			static const string* Intern(const string &value)
+			{
+				static Table tables[tableCount];
+				auto &table = tables[std::hash<string>()(value) % tableCount];
+
+				{
+					std::shared_lock<std::shared_timed_mutex> guard(table.lock);
+					auto i = table.strings.find(value);
+
+					if (i != table.strings.end())
+					{
+						return &*i;
+					}
+				}
+
+				std::unique_lock<std::shared_timed_mutex> guard(table.lock);
+				auto i = table.strings.find(value);
+
+				if (i != table.strings.end())
+				{
+					return &*i;
+				}
+
+				if (table.strings.size() >= maxTableSize)
+				{
+					return nullptr;
+				}
+
+				return &*table.strings.insert(value).first;
+			}
+
+			void Assign(const string &value)
+			{
+				value_ = value.empty() ? &Empty() : Intern(value);
+
+				if (value_ == nullptr)
+				{
+					owned_ = std::make_shared<const string>(value);
+					value_ = owned_.get();
+				}
+			}
+
+		public:
+			Key() : value_(&Empty()) {}
+			Key(const string &value) { Assign(value); }
+			Key(const char *value) { Assign(value); }
+
+			const string& AsString() const { return *value_; }
+			// an interned string outlives every key, so it can be referred to without a key
+			bool IsInterned() const { return owned_ == nullptr; }
+
+			bool operator==(const Key &other) const { return value_ == other.value_ || ((!IsInterned() || !other.IsInterned()) && *value_ == *other.value_); }
+			bool operator!=(const Key &other) const { return !(*this == other); }
+			bool operator<(const Key &other) const { return value_ != other.value_ && *value_ < *other.value_; }
+		};
+
+		// heterogeneous comparisons let maps find keys without interning them
+		inline bool operator<(const Key &left, const string &right) { return left.AsString() < right; }
+		inline bool operator<(const string &left, const Key &right) { return left < right.AsString(); }
+		inline bool operator<(const Key &left, const char *right) { return left.AsString().compare(right) < 0; }
+		inline bool operator<(const char *left, const Key &right) { return right.AsString().compare(left) > 0; }
+
+		inline std::ostream& operator<<(std::ostream &stream, const Key &key) { return stream << key.AsString(); }
+	}
+}
\ No newline at end of file
@@ -12,7 +12,7 @@ namespace Integro
 	{
 		Mave FromLdap(const LDAPEntry &entry)
 		{
-			map<string, Mave> mm;
+			Map mm;
 			auto al = entry.getAttributes();
 
 			for (auto a = al->begin(); a != al->end(); ++a)
@@ -30,16 +30,16 @@ namespace Integro
 				}
 				else
 				{
-					vector<Mave> mv;
+					Vector mv;
 					for (auto v = vl.begin(); v != vl.end(); ++v)
 					{
 						mv.push_back(*v);
 					}
-					mm.insert({ an, mv });
+					mm.insert({ an, move(mv) });
 				}
 			}
 
-			return mm;
+			return move(mm);
 		}
 	}
 }
\ No newline at end of file
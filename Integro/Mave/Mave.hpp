@@ -4,9 +4,13 @@
 #include <initializer_list>
 #include <vector>
 #include <map>
+#include <set>
 #include <sstream>
 #include <chrono>
 #include <functional>
+#include <atomic>
+#include <cstring>
+#include <algorithm>
 
 #include <boost/uuid/uuid.hpp>
 #include <boost/uuid/uuid_io.hpp>
@@ -14,6 +18,10 @@
 
 #include "Milliseconds.hpp"
 #include "Hash.hpp"
+#include "Mave/Arena.hpp"
+#include "Mave/Key.hpp"
+#include "Mave/FlatMap.hpp"
+#include "Mave/Walk.hpp"
 
 namespace Integro
 {
@@ -23,9 +31,8 @@ namespace Integro
 		using std::stringstream;
 		using std::vector;
 		using std::map;
+		using std::set;
 		using std::pair;
-		using std::shared_ptr;
-		using std::make_shared;
 		using std::exception;
 		using std::initializer_list;
 		using std::move;
@@ -34,6 +41,7 @@ namespace Integro
 		using boost::uuids::string_generator;
 		using std::function;
 
+		// the values are hashed by HashLong, so descriptors stored with it depend on them
 		enum MaveType
 		{
 			MAVE_NULL
@@ -48,300 +56,636 @@ namespace Integro
 			, MAVE_CUSTOM
 		};
 
+		class Mave;
+
+		// containers allocate from the current thread's arena if there is one
+		typedef vector<Mave, Allocator<Mave>> Vector;
+		typedef FlatMap<Key, Mave, Allocator<pair<Key, Mave>>> Map;
+
 		class Mave final
 		{
-			struct Type
+			// maps, vectors and customs live in a reference counted heap node,
+			// everything else is stored inline (strings rely on small string optimization),
+			// a string can also refer to an interned key, which is never freed
+			// nodes are copy-on-write: copies share a node until one of them asks for it mutably
+			struct Node
 			{
-				MaveType type_;
-				inline Type(const MaveType type) : type_(type) {}
+				std::atomic<long> count_;
+				inline Node() : count_(1) {}
+				virtual ~Node() {}
 			};
 
-			template <MaveType type, typename T>
-			struct Value : public Type
+			template <typename T>
+			struct Value : public Node
 			{
 				T value_;
-				inline Value(const T &value) : value_(value), Type(type) {}
-				inline Value(const T &&value) : value_(move(value)), Type(type) {}
+				inline Value(const T &value) : value_(value) {}
+				inline Value(T &&value) : value_(move(value)) {}
 			};
 
-			typedef Value<MAVE_NULL, nullptr_t> Null;
-			typedef Value<MAVE_VECTOR, vector<Mave>> Vector;
-			typedef Value<MAVE_MAP, map<string, Mave>> Map;
-			typedef Value<MAVE_BOOL, bool> Bool;
-			typedef Value<MAVE_INT, int> Int;
-			typedef Value<MAVE_LONG, long long> Long;
-			typedef Value<MAVE_DOUBLE, double> Double;
-			typedef Value<MAVE_STRING, string> String;
-			typedef Value<MAVE_MILLISECONDS, milliseconds> Milliseconds;
-			typedef Value<MAVE_CUSTOM, pair<uuid, string>> Custom;
-
-			static shared_ptr<Type> null_;
-			static shared_ptr<Type> true_;
-			static shared_ptr<Type> false_;
-			shared_ptr<Type> value;
+			typedef Value<Vector> VectorNode;
+			typedef Value<Map> MapNode;
+			typedef Value<pair<uuid, string>> CustomNode;
+
+			template <typename T, typename V>
+			static Node* Create(V &&value)
+			{
+				return new (Arena::Allocate(sizeof(T))) T(std::forward<V>(value));
+			}
+
+			MaveType type_;
+			bool isKey_ = false;
+			union
+			{
+				bool bool_;
+				int int_;
+				long long long_;
+				double double_;
+				milliseconds::rep milliseconds_;
+				string string_;
+				const string *key_;
+				Node *node_;
+			};
+
+			bool IsNode() const { return type_ == MAVE_VECTOR || type_ == MAVE_MAP || type_ == MAVE_CUSTOM; }
+
+			static void Unreference(Node *node)
+			{
+				if (--node->count_ == 0)
+				{
+					node->~Node();
+					Arena::Deallocate(node);
+				}
+			}
+
+			// clones a shared node one level deep, its children stay shared
+			template <typename T>
+			T& Detach()
+			{
+				auto node = (Value<T>*)node_;
+				if (node->count_ != 1)
+				{
+					node_ = Create<Value<T>>(node->value_);
+					Unreference(node);
+				}
+				return ((Value<T>*)node_)->value_;
+			}
+
+			void Release()
+			{
+				if (type_ == MAVE_STRING)
+				{
+					if (!isKey_) string_.~string();
+					isKey_ = false;
+				}
+				else if (IsNode())
+				{
+					Unreference(node_);
+				}
+				type_ = MAVE_NULL;
+			}
+
+			void Acquire(const Mave &other)
+			{
+				switch (other.type_)
+				{
+					case MAVE_BOOL: bool_ = other.bool_; break;
+					case MAVE_INT: int_ = other.int_; break;
+					case MAVE_LONG: long_ = other.long_; break;
+					case MAVE_DOUBLE: double_ = other.double_; break;
+					case MAVE_MILLISECONDS: milliseconds_ = other.milliseconds_; break;
+					case MAVE_STRING: if (other.isKey_) key_ = other.key_; else new (&string_) string(other.string_); isKey_ = other.isKey_; break;
+					case MAVE_VECTOR: case MAVE_MAP: case MAVE_CUSTOM: node_ = other.node_; ++node_->count_; break;
+					default: break;
+				}
+				type_ = other.type_;
+			}
+
+			void Acquire(Mave &&other)
+			{
+				switch (other.type_)
+				{
+					case MAVE_STRING: if (other.isKey_) { Acquire((const Mave&)other); return; } new (&string_) string(move(other.string_)); break;
+					case MAVE_VECTOR: case MAVE_MAP: case MAVE_CUSTOM: node_ = other.node_; type_ = other.type_; other.type_ = MAVE_NULL; return;
+					default: Acquire((const Mave&)other); return;
+				}
+				type_ = other.type_;
+				other.Release();
+			}
 
 		public:
-			MaveType GetType() const { return value->type_; }
-			bool HasType(const MaveType type) const { return type == value->type_; }
+			MaveType GetType() const { return type_; }
+			bool HasType(const MaveType type) const { return type == type_; }
 			void Assert(const MaveType type) const {
 				if (!HasType(type)) {
 					throw exception("Mave::Assert(): invalid type");
 				}
 			}
 
-			Mave() : value(null_) {}
-			Mave(nullptr_t) : value(null_) {}
+			Mave(const Mave &other) : type_(MAVE_NULL) { Acquire(other); }
+			Mave(Mave &&other) : type_(MAVE_NULL) { Acquire(move(other)); }
+			Mave& operator=(const Mave &other) { if (this != &other) { Release(); Acquire(other); } return *this; }
+			Mave& operator=(Mave &&other) { if (this != &other) { Release(); Acquire(move(other)); } return *this; }
+			~Mave() { Release(); }
+
+			Mave() : type_(MAVE_NULL) {}
+			Mave(nullptr_t) : type_(MAVE_NULL) {}
 			bool IsNull() const { return HasType(MAVE_NULL); }
 			nullptr_t AsNull() const { Assert(MAVE_NULL); return nullptr; }
 
 			template <class V, typename std::enable_if<
 				std::is_constructible<Mave, typename V::value_type>::value,
 				int>::type = 0>
-				Mave(const V &v) : Mave(vector<Mave>(v.begin(), v.end())) {}
-			Mave(vector<Mave> &value) : value(make_shared<Vector>(value)) {}
-			Mave(vector<Mave> &&value) : value(make_shared<Vector>(move(value))) {}
+				Mave(const V &v) : Mave(Vector(v.begin(), v.end())) {}
+			Mave(Vector &value) : type_(MAVE_VECTOR) { node_ = Create<VectorNode>(value); }
+			Mave(Vector &&value) : type_(MAVE_VECTOR) { node_ = Create<VectorNode>(move(value)); }
 			bool IsVector() const { return HasType(MAVE_VECTOR); }
-			vector<Mave>& AsVector() const { Assert(MAVE_VECTOR); return ((Vector*)value.get())->value_; }
-			Mave& operator[](int index) const { return AsVector().at(index); }
+			const Vector& AsVector() const { Assert(MAVE_VECTOR); return ((VectorNode*)node_)->value_; }
+			Vector& AsVector() { Assert(MAVE_VECTOR); return Detach<Vector>(); }
+			const Mave& operator[](int index) const { return AsVector().at(index); }
+			Mave& operator[](int index) { return AsVector().at(index); }
 
 			template <class M, typename std::enable_if<
-				std::is_constructible<std::string, typename M::key_type>::value
+				std::is_constructible<Key, typename M::key_type>::value
 				&& std::is_constructible<Mave, typename M::mapped_type>::value,
 				int>::type = 0>
-				Mave(const M &m) : Mave(map<string, Mave>(m.begin(), m.end())) {}
-			Mave(map<string, Mave> &value) : value(make_shared<Map>(value)) {}
-			Mave(map<string, Mave> &&value) : value(make_shared<Map>(move(value))) {}
+				Mave(const M &m) : Mave(Map(m.begin(), m.end())) {}
+			Mave(Map &value) : type_(MAVE_MAP) { node_ = Create<MapNode>(value); }
+			Mave(Map &&value) : type_(MAVE_MAP) { node_ = Create<MapNode>(move(value)); }
 			bool IsMap() const { return HasType(MAVE_MAP); }
-			map<string, Mave>& AsMap() const { Assert(MAVE_MAP); return ((Map*)value.get())->value_; }
-			Mave& operator[](const string &key) const { return AsMap().at(key); }
+			const Map& AsMap() const { Assert(MAVE_MAP); return ((MapNode*)node_)->value_; }
+			Map& AsMap() { Assert(MAVE_MAP); return Detach<Map>(); }
+			const Mave& operator[](const string &key) const {
+				auto &m = AsMap();
+				auto i = m.find(key);
+				if (i == m.end()) {
+					throw exception("Mave::operator[](): key not found");
+				}
+				return i->second;
+			}
+			Mave& operator[](const string &key) { AsMap(); return const_cast<Mave&>(((const Mave&)*this)[key]); }
 
 			Mave(void *) = delete;
-			Mave(bool value) : value(value ? true_ : false_) {}
+			Mave(bool value) : type_(MAVE_BOOL) { bool_ = value; }
 			bool IsBool() const { return HasType(MAVE_BOOL); }
-			bool AsBool() const { Assert(MAVE_BOOL); return ((Bool*)value.get())->value_; }
+			bool AsBool() const { Assert(MAVE_BOOL); return bool_; }
 
-			Mave(int value) : value(make_shared<Int>(value)) {}
+			Mave(int value) : type_(MAVE_INT) { int_ = value; }
 			bool IsInt() const { return HasType(MAVE_INT); }
-			int AsInt() const { Assert(MAVE_INT); return ((Int*)value.get())->value_; }
+			int AsInt() const { Assert(MAVE_INT); return int_; }
 
-			Mave(long long value) : value(make_shared<Long>(value)) {}
+			Mave(long long value) : type_(MAVE_LONG) { long_ = value; }
 			bool IsLong() const { return HasType(MAVE_LONG); }
-			long long AsLong() const { Assert(MAVE_LONG); return ((Long*)value.get())->value_; }
+			long long AsLong() const { Assert(MAVE_LONG); return long_; }
 
-			Mave(double value) : value(make_shared<Double>(value)) {}
+			Mave(double value) : type_(MAVE_DOUBLE) { double_ = value; }
 			bool IsDouble() const { return HasType(MAVE_DOUBLE); }
-			double AsDouble() const { Assert(MAVE_DOUBLE); return ((Double*)value.get())->value_; }
+			double AsDouble() const { Assert(MAVE_DOUBLE); return double_; }
 
-			Mave(const string &value) : value(make_shared<String>(value)) {}
-			Mave(const string &&value) : value(make_shared<String>(move(value))) {}
-			Mave(const char *value) : value(make_shared<String>(value)) {}
+			Mave(const string &value) : type_(MAVE_STRING) { new (&string_) string(value); }
+			Mave(string &&value) : type_(MAVE_STRING) { new (&string_) string(move(value)); }
+			Mave(const char *value) : type_(MAVE_STRING) { new (&string_) string(value); }
+			Mave(const Key &value) : type_(MAVE_STRING), isKey_(value.IsInterned()) { if (isKey_) key_ = &value.AsString(); else new (&string_) string(value.AsString()); }
 			bool IsString() const { return HasType(MAVE_STRING); }
-			string& AsString() const { Assert(MAVE_STRING); return ((String*)value.get())->value_; }
+			const string& AsString() const { Assert(MAVE_STRING); return isKey_ ? *key_ : string_; }
 
-			Mave(milliseconds value) : value(make_shared<Milliseconds>(value)) {}
+			Mave(milliseconds value) : type_(MAVE_MILLISECONDS) { milliseconds_ = value.count(); }
 			bool IsMilliseconds() const { return HasType(MAVE_MILLISECONDS); }
-			milliseconds AsMilliseconds() const { Assert(MAVE_MILLISECONDS); return ((Milliseconds*)value.get())->value_; }
+			milliseconds AsMilliseconds() const { Assert(MAVE_MILLISECONDS); return milliseconds(milliseconds_); }
 
-			Mave(const pair<uuid, string> &value) : value(make_shared<Custom>(value)) {}
-			Mave(const pair<uuid, string> &&value) : value(make_shared<Custom>(move(value))) {}
+			Mave(const pair<uuid, string> &value) : type_(MAVE_CUSTOM) { node_ = Create<CustomNode>(value); }
+			Mave(pair<uuid, string> &&value) : type_(MAVE_CUSTOM) { node_ = Create<CustomNode>(move(value)); }
 			bool IsCustom() const { return HasType(MAVE_CUSTOM); }
-			pair<uuid, string>& AsCustom() const { Assert(MAVE_CUSTOM); return ((Custom*)value.get())->value_; }
+			const pair<uuid, string>& AsCustom() const { Assert(MAVE_CUSTOM); return ((CustomNode*)node_)->value_; }
+			pair<uuid, string>& AsCustom() { Assert(MAVE_CUSTOM); return Detach<pair<uuid, string>>(); }
+
+			// true if both maves refer to the same copy-on-write node, such maves are equal
+			bool Shares(const Mave &other) const { return IsNode() && type_ == other.type_ && node_ == other.node_; }
 		};
 
-		shared_ptr<Mave::Type> Mave::null_ = make_shared<Null>(nullptr);
-		shared_ptr<Mave::Type> Mave::true_ = make_shared<Bool>(true);
-		shared_ptr<Mave::Type> Mave::false_ = make_shared<Bool>(false);
+		// copies share the whole tree, nodes are cloned level by level as they are mutated
+		Mave Copy(const Mave &root)
+		{
+			return root;
+		}
+
+		struct MaveSource
+		{
+			typedef const Mave *Node;
+			typedef Map::const_iterator MapIterator;
+			typedef Vector::const_iterator VectorIterator;
+
+			static WalkKind Kind(Node node) { return node->IsMap() ? WALK_MAP : node->IsVector() ? WALK_VECTOR : WALK_SCALAR; }
+			static MapIterator MapBegin(Node node) { return node->AsMap().cbegin(); }
+			static MapIterator MapEnd(Node node) { return node->AsMap().cend(); }
+			static VectorIterator VectorBegin(Node node) { return node->AsVector().cbegin(); }
+			static VectorIterator VectorEnd(Node node) { return node->AsVector().cend(); }
+			static const Key& MapKey(MapIterator i) { return i->first; }
+			static Node MapValue(MapIterator i) { return &i->second; }
+			static Node VectorValue(VectorIterator i) { return &*i; }
+		};
 
-		Mave Copy(Mave mave)
+		// builds a mave from walk events, a source specific visitor converts scalars and calls Add
+		class Builder
 		{
-			Mave result;
-			vector<function<bool()>> continuations;
-			auto root = mave;
+			struct Frame
+			{
+				Mave value;
+				Key key;
+			};
+
+			vector<Frame> frames_;
+			Mave result_;
 
-			while (true)
+			void Begin(Mave &&value)
 			{
-				switch (mave.GetType())
+				frames_.emplace_back();
+				frames_.back().value = move(value);
+			}
+
+			void End()
+			{
+				auto value = move(frames_.back().value);
+				frames_.pop_back();
+				Add(move(value));
+			}
+
+		public:
+			void Add(Mave &&value)
+			{
+				if (frames_.empty())
+				{
+					result_ = move(value);
+				}
+				else if (frames_.back().value.IsMap())
+				{
+					frames_.back().value.AsMap().insert({ frames_.back().key, move(value) });
+				}
+				else
+				{
+					frames_.back().value.AsVector().push_back(move(value));
+				}
+			}
+
+			template <typename N> void BeginMap(const N&) { Begin(Map()); }
+			void Field(const Key &key, bool) { frames_.back().key = key; }
+			void EndMap() { End(); }
+			template <typename N> void BeginVector(const N&) { Begin(Vector()); }
+			void Item(bool) {}
+			void EndVector() { End(); }
+
+			Mave& Result() { return result_; }
+		};
+
+		class StringWriter
+		{
+			stringstream &result_;
+
+		public:
+			StringWriter(stringstream &result) : result_(result) {}
+
+			void Scalar(const Mave *mave)
+			{
+				switch (mave->GetType())
 				{
 					case MAVE_NULL:
-						result = nullptr;
+						result_ << "null";
 						break;
 					case MAVE_BOOL:
-						result = mave.AsBool();
+						result_ << (mave->AsBool() ? "true" : "false");
 						break;
 					case MAVE_INT:
-						result = mave.AsInt();
+						result_ << mave->AsInt();
 						break;
 					case MAVE_LONG:
-						result = mave.AsLong();
+						result_ << mave->AsLong() << "L";
 						break;
 					case MAVE_DOUBLE:
-						result = mave.AsDouble();
+						result_ << mave->AsDouble() << "D";
 						break;
 					case MAVE_MILLISECONDS:
-						result = mave.AsMilliseconds();
+						result_ << Milliseconds::ToUtc(mave->AsMilliseconds(), true);
 						break;
 					case MAVE_STRING:
-						result = mave.AsString();
+						result_ << "\"" << mave->AsString() << "\"";
 						break;
 					case MAVE_CUSTOM:
-						result = mave.AsCustom();
+						result_ << "(\"" << mave->AsCustom().first << "\":\"" << mave->AsCustom().second << "\")";
 						break;
-					case MAVE_MAP:
-						continuations.push_back(
-							[&
-							, m = map<string, Mave>()
-							, i = mave.AsMap().cbegin()
-							, e = mave.AsMap().cend()
-							, f = false]() mutable -> bool
-						{
-							if (f)
-							{
-								m.insert({ i->first, result });
-								++i;
-							}
-							if (i != e)
-							{
-								mave = i->second;
-								return f = true;
-							}
-							result = move(m);
-							return false;
-						});
+					default:
+						throw exception("Mave::ToString(): unsupported type encountered");
+				}
+			}
+
+			void BeginMap(const Mave*) { result_ << "{"; }
+			void Field(const Key &key, bool first) { if (!first) result_ << ","; result_ << "\"" << key << "\":"; }
+			void EndMap() { result_ << "}"; }
+			void BeginVector(const Mave*) { result_ << "["; }
+			void Item(bool first) { if (!first) result_ << ","; }
+			void EndVector() { result_ << "]"; }
+		};
+
+		string ToString(const Mave &root)
+		{
+			stringstream result;
+			StringWriter writer(result);
+			Walk<MaveSource>(&root, writer);
+			return result.str();
+		}
+
+		// renders a mave, use HashLong for new descriptors
+		int Hash(const Mave &mave)
+		{
+			return ::Integro::Hash(ToString(mave));
+		}
+
+		// feeds type tags and raw values into a streaming hash (Hash64 or Hash128) without rendering them,
+		// numbers are little endian and lengths are 64 bit, so the result does not depend on the platform
+		template <typename H>
+		class Hasher
+		{
+			H &hash_;
+
+			void Tag(const MaveType type) { auto tag = (unsigned char)type; hash_.Update(&tag, 1); }
+
+			void Number(const unsigned long long value)
+			{
+				unsigned char bytes[8];
+				for (int i = 0; i < 8; ++i)
+				{
+					bytes[i] = (unsigned char)(value >> (8 * i));
+				}
+				hash_.Update(bytes, 8);
+			}
+
+			void Bytes(const string &value)
+			{
+				Number(value.size());
+				hash_.Update(value);
+			}
+
+		public:
+			Hasher(H &hash) : hash_(hash) {}
+
+			void Scalar(const Mave *mave)
+			{
+				auto type = mave->GetType();
+				Tag(type);
+
+				switch (type)
+				{
+					case MAVE_NULL:
 						break;
-					case MAVE_VECTOR:
-						continuations.push_back(
-							[&
-							, v = vector<Mave>()
-							, i = mave.AsVector().cbegin()
-							, e = mave.AsVector().cend()
-							, f = false]() mutable -> bool
-						{
-							if (f)
-							{
-								v.push_back(result);
-								++i;
-							}
-							if (i != e)
-							{
-								mave = *i;
-								return f = true;
-							}
-							result = move(v);
-							return false;
-						});
+					case MAVE_BOOL:
+						Number(mave->AsBool() ? 1 : 0);
+						break;
+					case MAVE_INT:
+						Number((unsigned long long)(long long)mave->AsInt());
+						break;
+					case MAVE_LONG:
+						Number((unsigned long long)mave->AsLong());
+						break;
+					case MAVE_DOUBLE:
+					{
+						// 0.0 and -0.0 are equal, so they hash the same
+						auto value = mave->AsDouble() == 0 ? 0.0 : mave->AsDouble();
+						unsigned long long bits;
+						memcpy(&bits, &value, 8);
+						Number(bits);
+						break;
+					}
+					case MAVE_MILLISECONDS:
+						Number((unsigned long long)mave->AsMilliseconds().count());
+						break;
+					case MAVE_STRING:
+						Bytes(mave->AsString());
+						break;
+					case MAVE_CUSTOM:
+						hash_.Update(mave->AsCustom().first.data, 16);
+						Bytes(mave->AsCustom().second);
 						break;
 					default:
-						throw exception("Mave::Copy(): unsupported type encountered");
+						throw exception("Mave::Hasher::Scalar(): unsupported type encountered");
 				}
+			}
 
-				while (true)
+			void BeginMap(const Mave *mave) { Tag(MAVE_MAP); Number(mave->AsMap().size()); }
+			void Field(const Key &key, bool) { Bytes(key.AsString()); }
+			void EndMap() {}
+			void BeginVector(const Mave *mave) { Tag(MAVE_VECTOR); Number(mave->AsVector().size()); }
+			void Item(bool) {}
+			void EndVector() {}
+		};
+
+		// a structural 64 bit hash, stable across processes and platforms
+		long long HashLong(const Mave &mave)
+		{
+			Hash64 hash;
+			Hasher<Hash64> hasher(hash);
+			Walk<MaveSource>(&mave, hasher);
+			return (long long)hash.Digest();
+		}
+
+		// the same structural hash with 128 bits, for content addressing where collisions must not happen
+		Digest128 HashWide(const Mave &mave)
+		{
+			Hash128 hash;
+			Hasher<Hash128> hasher(hash);
+			Walk<MaveSource>(&mave, hasher);
+			return hash.Digest();
+		}
+
+		// adds up the memory held by a mave: containers with their elements, nodes and heap allocated strings,
+		// a node shared by copies is counted for every copy, map keys are interned and not counted
+		class SizeEstimator
+		{
+			// a vtable pointer, a reference count and an allocation header
+			static const size_t nodeSize = 2 * sizeof(void*) + 16;
+			// strings of this length and longer are assumed to be on the heap
+			static const size_t heapStringSize = 16;
+
+			size_t size_;
+
+			void String(const string &value) { if (value.size() >= heapStringSize) size_ += value.capacity() + 1; }
+
+		public:
+			SizeEstimator() : size_(sizeof(Mave)) {}
+
+			size_t Size() const { return size_; }
+
+			void Scalar(const Mave *mave)
+			{
+				if (mave->IsString())
 				{
-					if (continuations.size() == 0)
+					String(mave->AsString());
+				}
+				else if (mave->IsCustom())
+				{
+					size_ += nodeSize + sizeof(pair<uuid, string>);
+					String(mave->AsCustom().second);
+				}
+			}
+
+			void BeginMap(const Mave *mave) { size_ += nodeSize + sizeof(Map) + mave->AsMap().size() * sizeof(Map::value_type); }
+			void Field(const Key&, bool) {}
+			void EndMap() {}
+			void BeginVector(const Mave *mave) { size_ += nodeSize + sizeof(Vector) + mave->AsVector().size() * sizeof(Mave); }
+			void Item(bool) {}
+			void EndVector() {}
+		};
+
+		// an estimate of the memory held by a mave in bytes, used to limit buffered data
+		size_t EstimateSize(const Mave &mave)
+		{
+			SizeEstimator estimator;
+			Walk<MaveSource>(&mave, estimator);
+			return estimator.Size();
+		}
+
+		// a 128 bit hash of a map's fields that does not depend on ignored attributes,
+		// vectors of set attributes, or all vectors if areVectorsSets, are hashed regardless of the order of their items,
+		// so an ldap entry whose multi-valued attributes come in another order keeps its fingerprint
+		Digest128 Fingerprint(const Mave &mave, const set<string> &ignoredAttributes, const set<string> &setAttributes, const bool areVectorsSets)
+		{
+			if (!mave.IsMap())
+			{
+				return HashWide(mave);
+			}
+
+			auto Number = [](Hash128 &hash, const unsigned long long value)
+			{
+				unsigned char bytes[8];
+				for (int i = 0; i < 8; ++i) bytes[i] = (unsigned char)(value >> (8 * i));
+				hash.Update(bytes, 8);
+			};
+			auto Digest = [&](Hash128 &hash, const Digest128 &value) { Number(hash, value.low); Number(hash, value.high); };
+
+			Hash128 hash;
+			vector<Digest128> items;
+
+			// fields are sorted by key, so their order is canonical already
+			for (auto &field : mave.AsMap())
+			{
+				const auto &key = field.first.AsString();
+
+				if (ignoredAttributes.count(key) != 0)
+				{
+					continue;
+				}
+
+				Number(hash, key.size());
+				hash.Update(key);
+
+				if (field.second.IsVector() && (areVectorsSets || setAttributes.count(key) != 0))
+				{
+					items.clear();
+
+					for (auto &item : field.second.AsVector())
 					{
-						return result;
+						items.push_back(HashWide(item));
 					}
-					if (continuations.back()())
+
+					std::sort(items.begin(), items.end());
+
+					Hash128 itemsHash;
+					Number(itemsHash, MAVE_VECTOR);
+					Number(itemsHash, items.size());
+
+					for (auto &item : items)
 					{
-						break;
+						Digest(itemsHash, item);
 					}
-					continuations.pop_back();
+
+					Digest(hash, itemsHash.Digest());
+				}
+				else
+				{
+					Digest(hash, HashWide(field.second));
 				}
 			}
+
+			return hash.Digest();
 		}
 
-		string ToString(Mave mave)
+		// compares maves structurally, values of different types are not equal,
+		// equal maves have equal HashLong
+		bool Equal(const Mave &left, const Mave &right)
 		{
-			stringstream result;
-			vector<function<bool()>> continuations;
-			auto root = mave;
+			static thread_local vector<pair<const Mave*, const Mave*>> pairs;
+			pairs.clear();
+			pairs.emplace_back(&left, &right);
 
-			while (true)
+			while (!pairs.empty())
 			{
-				switch (mave.GetType())
+				auto &a = *pairs.back().first;
+				auto &b = *pairs.back().second;
+				pairs.pop_back();
+
+				if (a.GetType() != b.GetType())
+				{
+					return false;
+				}
+
+				if (a.Shares(b))
+				{
+					continue;
+				}
+
+				switch (a.GetType())
 				{
 					case MAVE_NULL:
-						result << "null";
 						break;
 					case MAVE_BOOL:
-						result << (mave.AsBool() ? "true" : "false");
+						if (a.AsBool() != b.AsBool()) return false;
 						break;
 					case MAVE_INT:
-						result << mave.AsInt();
+						if (a.AsInt() != b.AsInt()) return false;
 						break;
 					case MAVE_LONG:
-						result << mave.AsLong() << "L";
+						if (a.AsLong() != b.AsLong()) return false;
 						break;
 					case MAVE_DOUBLE:
-						result << mave.AsDouble() << "D";
+						if (a.AsDouble() != b.AsDouble()) return false;
 						break;
 					case MAVE_MILLISECONDS:
-						result << Milliseconds::ToUtc(mave.AsMilliseconds(), true);
+						if (a.AsMilliseconds() != b.AsMilliseconds()) return false;
 						break;
 					case MAVE_STRING:
-						result << "\"" << mave.AsString() << "\"";
+						if (a.AsString() != b.AsString()) return false;
 						break;
 					case MAVE_CUSTOM:
-						result << "(\"" << mave.AsCustom().first << "\":\"" << mave.AsCustom().second << "\")";
-						break;
-					case MAVE_MAP:
-						result << "{";
-						continuations.push_back(
-							[&
-							, i = mave.AsMap().cbegin()
-							, e = mave.AsMap().cend()
-							, f = false]() mutable -> bool
-						{
-							if (i != e)
-							{
-								if (f) result << ",";
-								result << "\"" << i->first << "\":";
-								mave = i++->second;
-								return f = true;
-							}
-							result << "}";
-							return false;
-						});
+						if (a.AsCustom() != b.AsCustom()) return false;
 						break;
 					case MAVE_VECTOR:
-						result << "[";
-						continuations.push_back(
-							[&
-							, i = mave.AsVector().cbegin()
-							, e = mave.AsVector().cend()
-							, f = false]() mutable -> bool
+					{
+						auto &u = a.AsVector();
+						auto &v = b.AsVector();
+						if (u.size() != v.size()) return false;
+						for (size_t i = 0; i < u.size(); ++i)
 						{
-							if (i != e)
-							{
-								if (f) result << ",";
-								mave = *i++;
-								return f = true;
-							}
-							result << "]";
-							return false;
-						});
+							pairs.emplace_back(&u[i], &v[i]);
+						}
 						break;
-					default:
-						throw exception("Mave::ToString(): unsupported type encountered");
-				}
-
-				while (true)
-				{
-					if (continuations.size() == 0)
-					{
-						return result.str();
 					}
-					if (continuations.back()())
+					case MAVE_MAP:
 					{
+						// both maps are sorted by key, so fields pair up in order
+						auto &m = a.AsMap();
+						auto &n = b.AsMap();
+						if (m.size() != n.size()) return false;
+						for (auto i = m.begin(), j = n.begin(); i != m.end(); ++i, ++j)
+						{
+							if (i->first != j->first) return false;
+							pairs.emplace_back(&i->second, &j->second);
+						}
 						break;
 					}
-					continuations.pop_back();
+					default:
+						throw exception("Mave::Equal(): unsupported type encountered");
 				}
 			}
-		}
 
-		int Hash(Mave mave)
-		{
-			return ::Integro::Hash(ToString(mave));
+			return true;
 		}
 	}
 }
\ No newline at end of file
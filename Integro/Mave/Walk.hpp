@@ -0,0 +1,116 @@
+#pragma once
+
+#include <vector>
+
+namespace Integro
+{
+	namespace Mave
+	{
+		enum WalkKind
+		{
+			WALK_SCALAR
+			, WALK_MAP
+			, WALK_VECTOR
+		};
+
+		// a source describes how to read a tree:
+		//	Node							a cheap handle to a node, such as a pointer or a view
+		//	MapIterator, VectorIterator		iterators over map and vector children
+		//	Kind(node)						WALK_SCALAR, WALK_MAP or WALK_VECTOR
+		//	MapBegin(node), MapEnd(node), VectorBegin(node), VectorEnd(node)
+		//	MapKey(mapIterator), MapValue(mapIterator), VectorValue(vectorIterator)
+		//
+		// a visitor receives
+		//	Scalar(node)
+		//	BeginMap(node), Field(key, first), EndMap()
+		//	BeginVector(node), Item(first), EndVector()
+		template <typename Source>
+		struct WalkFrame
+		{
+			bool isMap;
+			bool first;
+			typename Source::MapIterator i, e;
+			typename Source::VectorIterator j, f;
+		};
+
+		// walks a tree depth first without recursion,
+		// frames are kept in a per thread stack that is reused between walks
+		template <typename Source, typename Visitor>
+		void Walk(typename Source::Node node, Visitor &visitor)
+		{
+			static thread_local std::vector<WalkFrame<Source>> frames;
+			auto base = frames.size();
+
+			try
+			{
+				while (true)
+				{
+					switch (Source::Kind(node))
+					{
+						case WALK_MAP:
+							visitor.BeginMap(node);
+							frames.emplace_back();
+							frames.back().isMap = true;
+							frames.back().first = true;
+							frames.back().i = Source::MapBegin(node);
+							frames.back().e = Source::MapEnd(node);
+							break;
+						case WALK_VECTOR:
+							visitor.BeginVector(node);
+							frames.emplace_back();
+							frames.back().isMap = false;
+							frames.back().first = true;
+							frames.back().j = Source::VectorBegin(node);
+							frames.back().f = Source::VectorEnd(node);
+							break;
+						default:
+							visitor.Scalar(node);
+							break;
+					}
+
+					while (true)
+					{
+						if (frames.size() == base)
+						{
+							return;
+						}
+
+						auto &frame = frames.back();
+						auto first = frame.first;
+						frame.first = false;
+
+						if (frame.isMap)
+						{
+							if (frame.i != frame.e)
+							{
+								auto i = frame.i++;
+								visitor.Field(Source::MapKey(i), first);
+								node = Source::MapValue(i);
+								break;
+							}
+							frames.pop_back();
+							visitor.EndMap();
+						}
+						else
+						{
+							if (frame.j != frame.f)
+							{
+								auto j = frame.j++;
+								visitor.Item(first);
+								node = Source::VectorValue(j);
+								break;
+							}
+							frames.pop_back();
+							visitor.EndVector();
+						}
+					}
+				}
+			}
+			catch (...)
+			{
+				frames.resize(base);
+				throw;
+			}
+		}
+	}
+}
\ No newline at end of file
@@ -0,0 +1,214 @@
+#pragma once
+
+#include <vector>
+#include <map>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <functional>
+#include <exception>
+#include <utility>
+
+#include "Synchronized.hpp"
+
+namespace Integro
+{
+	using std::vector;
+	using std::map;
+	using std::unique_ptr;
+	using std::thread;
+	using std::mutex;
+	using std::unique_lock;
+	using std::function;
+
+	// stages that run on their own threads and are connected by bounded queues,
+	// a stage runs up to its concurrency items at once but passes them on in the order they were produced,
+	// so every stage and the commit see the items in that order
+	template <
+		typename T>
+		class Pipeline
+	{
+	public:
+		struct Stage
+		{
+			function<void(T&)> Run;
+			size_t concurrency;
+
+			Stage(
+				function<void(T&)> Run
+				, const size_t concurrency = 1)
+				: Run(Run)
+				, concurrency(concurrency == 0 ? 1 : concurrency)
+			{
+			}
+		};
+
+	private:
+		struct Item
+		{
+			size_t number;
+			T value;
+		};
+
+		// items a stage has finished ahead of an earlier item that is still running
+		struct Output
+		{
+			mutex lock;
+			map<size_t, Item> items;
+			size_t nextNumber;
+			std::atomic<size_t> workerCount;
+		};
+
+		vector<Stage> stages_;
+
+	public:
+		explicit Pipeline(
+			vector<Stage> stages)
+			: stages_(std::move(stages))
+		{
+		}
+
+		// runs Produce on the calling thread and Commit on a thread of its own,
+		// an item is committed after all stages have run it and after all earlier items are committed,
+		// returns when all produced items are committed, or stops all stages and rethrows the first exception
+		void
+			Run(
+				function<void(function<bool(T&&)>)> Produce
+				, function<void(T&)> Commit)
+		{
+			auto stageCount = stages_.size();
+			// the input of each stage and of the commit
+			vector<unique_ptr<BoundedQueue<Item>>> queues;
+			vector<unique_ptr<Output>> outputs;
+			vector<thread> threads;
+			std::atomic<bool> hasFailed(false);
+			mutex errorLock;
+			std::exception_ptr error;
+
+			for (size_t i = 0; i < stageCount; ++i)
+			{
+				queues.emplace_back(new BoundedQueue<Item>(stages_[i].concurrency + 1));
+				outputs.emplace_back(new Output());
+				outputs[i]->nextNumber = 0;
+				outputs[i]->workerCount = stages_[i].concurrency;
+			}
+
+			queues.emplace_back(new BoundedQueue<Item>(2));
+
+			auto Fail = [&]()
+			{
+				{
+					unique_lock<mutex> guard(errorLock);
+
+					if (error == nullptr)
+					{
+						error = std::current_exception();
+					}
+
+					hasFailed = true;
+				}
+
+				for (auto &queue : queues)
+				{
+					queue->Close();
+				}
+			};
+
+			auto Work = [&](size_t stageIndex)
+			{
+				auto &stage = stages_[stageIndex];
+				auto &output = *outputs[stageIndex];
+				auto &nextQueue = *queues[stageIndex + 1];
+
+				try
+				{
+					vector<Item> items;
+
+					while (!hasFailed && queues[stageIndex]->PopAll(items, nullptr, 1))
+					{
+						stage.Run(items[0].value);
+
+						unique_lock<mutex> guard(output.lock);
+						output.items.emplace(items[0].number, std::move(items[0]));
+
+						while (!output.items.empty() && output.items.begin()->first == output.nextNumber)
+						{
+							if (!nextQueue.Push(std::move(output.items.begin()->second)))
+							{
+								return;
+							}
+
+							output.items.erase(output.items.begin());
+							++output.nextNumber;
+						}
+					}
+				}
+				catch (...)
+				{
+					Fail();
+				}
+
+				// the last worker of a stage has passed on all its items
+				if (--output.workerCount == 0)
+				{
+					nextQueue.Close();
+				}
+			};
+
+			for (size_t i = 0; i < stageCount; ++i)
+			{
+				for (size_t j = 0; j < stages_[i].concurrency; ++j)
+				{
+					threads.emplace_back(Work, i);
+				}
+			}
+
+			threads.emplace_back([&]()
+			{
+				try
+				{
+					vector<Item> items;
+
+					while (!hasFailed && queues[stageCount]->PopAll(items, nullptr, 1))
+					{
+						Commit(items[0].value);
+					}
+				}
+				catch (...)
+				{
+					Fail();
+				}
+			});
+
+			try
+			{
+				size_t number = 0;
+
+				Produce([&](T &&value)
+				{
+					Item item;
+					item.number = number++;
+					item.value = std::move(value);
+					return queues[0]->Push(std::move(item));
+				});
+			}
+			catch (...)
+			{
+				Fail();
+			}
+
+			queues[0]->Close();
+
+			for (auto &t : threads)
+			{
+				t.join();
+			}
+
+			if (error != nullptr)
+			{
+				std::rethrow_exception(error);
+			}
+		}
+	};
+}
\ No newline at end of file
@@ -0,0 +1,175 @@
+#pragma once
+
+#include <vector>
+#include <map>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <chrono>
+
+namespace Integro
+{
+	using std::vector;
+	using std::map;
+	using std::string;
+	using std::thread;
+	using std::mutex;
+	using std::unique_lock;
+	using std::condition_variable;
+	using std::function;
+	using std::chrono::milliseconds;
+	using std::chrono::steady_clock;
+
+	// runs tasks again and again on a fixed set of threads, a task runs a period after its previous run has finished,
+	// tasks of a group, such as the topics of one server, run at most the group's limit at once,
+	// a task is never run twice at once, and of the tasks that are due the one that has waited longest runs first
+	class Scheduler
+	{
+		struct Task
+		{
+			string group;
+			milliseconds period;
+			function<void()> Run;
+			steady_clock::time_point next;
+			bool isRunning;
+		};
+
+		size_t threadCount_;
+		vector<Task> tasks_;
+		map<string, size_t> limits_;
+		map<string, size_t> runningCounts_;
+		mutex mutex_;
+		condition_variable hasChanged_;
+		bool isStopping_;
+
+		bool
+			HasRoom(
+				const string &group)
+		{
+			auto limit = limits_.find(group);
+			return limit == limits_.end() || runningCounts_[group] < limit->second;
+		}
+
+		void
+			Work()
+		{
+			unique_lock<mutex> lock(mutex_);
+
+			while (!isStopping_)
+			{
+				auto now = steady_clock::now();
+				Task *due = nullptr;
+				auto wakeTime = steady_clock::time_point::max();
+
+				for (auto &task : tasks_)
+				{
+					if (task.isRunning || !HasRoom(task.group))
+					{
+						continue;
+					}
+
+					if (task.next <= now)
+					{
+						if (due == nullptr || task.next < due->next)
+						{
+							due = &task;
+						}
+					}
+					else if (task.next < wakeTime)
+					{
+						wakeTime = task.next;
+					}
+				}
+
+				if (due == nullptr)
+				{
+					if (wakeTime == steady_clock::time_point::max())
+					{
+						hasChanged_.wait(lock);
+					}
+					else
+					{
+						hasChanged_.wait_until(lock, wakeTime);
+					}
+
+					continue;
+				}
+
+				due->isRunning = true;
+				++runningCounts_[due->group];
+				lock.unlock();
+
+				due->Run();
+
+				lock.lock();
+				due->isRunning = false;
+				--runningCounts_[due->group];
+				due->next = steady_clock::now() + due->period;
+				hasChanged_.notify_all();
+			}
+		}
+
+	public:
+		Scheduler(const Scheduler&) = delete;
+		Scheduler& operator=(const Scheduler&) = delete;
+
+		explicit Scheduler(
+			const size_t threadCount)
+			: threadCount_(threadCount == 0 ? 1 : threadCount)
+			, isStopping_(false)
+		{
+		}
+
+		// groups without a limit are not limited
+		void
+			SetLimit(
+				const string &group
+				, const size_t maxRunningCount)
+		{
+			unique_lock<mutex> lock(mutex_);
+			limits_[group] = maxRunningCount == 0 ? 1 : maxRunningCount;
+		}
+
+		// tasks are expected to be added before Run and not to throw, a task first runs as soon as Run starts
+		void
+			Add(
+				const string &group
+				, const milliseconds period
+				, function<void()> Run)
+		{
+			unique_lock<mutex> lock(mutex_);
+			tasks_.push_back({ group, period, Run, steady_clock::now(), false });
+		}
+
+		// runs tasks until Stop is called, then waits for running tasks to finish
+		void
+			Run()
+		{
+			vector<thread> threads;
+
+			for (size_t i = 0; i < threadCount_; ++i)
+			{
+				threads.emplace_back([this]() { Work(); });
+			}
+
+			for (auto &t : threads)
+			{
+				t.join();
+			}
+		}
+
+		// can be called from any thread, including from a task
+		void
+			Stop()
+		{
+			{
+				unique_lock<mutex> lock(mutex_);
+				isStopping_ = true;
+			}
+
+			hasChanged_.notify_all();
+		}
+	};
+}
\ No newline at end of file
@@ -1,73 +1,430 @@
 #pragma once
 
 #include <vector>
-#include <atomic>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <limits>
+#include <utility>
 
 namespace Integro
 {
 	using std::vector;
-	using std::atomic_flag;
+	using std::deque;
+	using std::mutex;
+	using std::unique_lock;
+	using std::condition_variable;
+	using std::pair;
 
+	// a bounded multi-producer multi-consumer queue over a ring buffer,
+	// waiting threads sleep on condition variables instead of spinning or polling,
+	// items can be limited by count and by their total size as given by producers
 	template <
 		typename T>
-		class SynchronizedBuffer
+		class BoundedQueue
 	{
 		vector<T> items;
-		atomic_flag lock;
+		vector<size_t> itemSizes;
+		size_t head;
+		size_t count;
+		size_t size;
+		size_t maxSize;
+		bool isClosed;
+		mutex lock;
+		condition_variable hasItems;
+		condition_variable hasRoom;
+
+		template <
+			typename U>
+			bool
+			PushOne(
+				U &&item
+				, const size_t itemSize)
+		{
+			unique_lock<mutex> guard(lock);
+
+			// an item larger than maxSize is let into an empty queue
+			hasRoom.wait(guard, [&]()
+			{
+				return isClosed
+					|| (count < items.size() && (count == 0 || maxSize == 0 || size + itemSize <= maxSize));
+			});
+
+			if (isClosed)
+			{
+				return false;
+			}
+
+			auto tail = (head + count) % items.size();
+			items[tail] = std::forward<U>(item);
+			itemSizes[tail] = itemSize;
+			++count;
+			size += itemSize;
+			guard.unlock();
+			hasItems.notify_one();
+
+			return true;
+		}
 
 	public:
-		SynchronizedBuffer()
+		// maxSize of 0 does not limit the size
+		explicit BoundedQueue(
+			const size_t capacity
+			, const size_t maxSize = 0)
+			: items(capacity == 0 ? 1 : capacity)
+			, itemSizes(items.size())
+			, head(0)
+			, count(0)
+			, size(0)
+			, maxSize(maxSize)
+			, isClosed(false)
+		{
+		}
+
+		// waits while the queue is full, returns false if the queue is closed
+		bool
+			Push(
+				const T &item
+				, const size_t itemSize = 0)
 		{
-			lock.clear();
+			return PushOne(item, itemSize);
 		}
 
 		bool
-			IsEmpty()
+			Push(
+				T &&item
+				, const size_t itemSize = 0)
+		{
+			return PushOne(std::move(item), itemSize);
+		}
+
+		// waits for items and moves up to maxCount of them, of at most maxSize in total, to data, replacing its contents,
+		// the first item is moved whatever its size, maxSize of 0 does not limit the size,
+		// dataSize receives the total size of the moved items,
+		// returns false when the queue is closed and there are no items left
+		bool
+			PopAll(
+				vector<T> &data
+				, size_t *dataSize = nullptr
+				, const size_t maxCount = (std::numeric_limits<size_t>::max)()
+				, const size_t maxSize = 0)
+		{
+			data.clear();
+
+			unique_lock<mutex> guard(lock);
+			hasItems.wait(guard, [this]() { return isClosed || count > 0; });
+
+			if (count == 0)
+			{
+				return false;
+			}
+
+			size_t popCount = 0;
+			size_t popSize = 0;
+
+			for (; popCount < count && popCount < maxCount; ++popCount)
+			{
+				if (popCount > 0 && maxSize != 0 && popSize + itemSizes[head] > maxSize)
+				{
+					break;
+				}
+
+				data.push_back(std::move(items[head]));
+				items[head] = T();
+				popSize += itemSizes[head];
+				head = (head + 1) % items.size();
+			}
+
+			count -= popCount;
+			size -= popSize;
+
+			if (dataSize != nullptr)
+			{
+				*dataSize = popSize;
+			}
+
+			guard.unlock();
+			hasRoom.notify_all();
+
+			return true;
+		}
+
+		// makes Push fail and lets PopAll return the remaining items, can be called more than once
+		void
+			Close()
 		{
-			while (lock.test_and_set());
-			bool result = items.empty();
-			lock.clear();
+			{
+				unique_lock<mutex> guard(lock);
+				isClosed = true;
+			}
+
+			hasItems.notify_all();
+			hasRoom.notify_all();
+		}
 
-			return result;
+		size_t
+			Count()
+		{
+			unique_lock<mutex> guard(lock);
+			return count;
 		}
 
-		int
+		size_t
 			Size()
 		{
-			while (lock.test_and_set());
-			auto result = items.size();
-			lock.clear();
+			unique_lock<mutex> guard(lock);
+			return size;
+		}
+	};
+
+	// a bounded queue whose items are read by several readers, each at its own position,
+	// an item is kept until every reader has passed it and it has been popped,
+	// a reader that gives up is detached and no longer holds items back,
+	// items can be limited by their total count and size as given by producers, such as the datums of a batch,
+	// if detachesLaggingReaders is set, a full buffer detaches the readers that have passed none of its items
+	// once another reader has passed them all, items well below the limits make such readers lag by several of them
+	template <
+		typename T>
+		class ReplayBuffer
+	{
+		deque<T> items;
+		deque<pair<size_t, size_t>> itemCountsAndSizes;
+		// the position of the first item since the buffer was created
+		size_t first;
+		size_t count;
+		size_t size;
+		size_t maxCount;
+		size_t maxSize;
+		vector<size_t> positions;
+		vector<bool> isDetached;
+		bool detachesLaggingReaders;
+		bool isClosed;
+		mutex lock;
+		condition_variable hasChanged;
+
+		// the position before which all attached readers have passed all items
+		size_t
+			Passed() const
+		{
+			auto passed = first + items.size();
+
+			for (size_t i = 0; i < positions.size(); ++i)
+			{
+				if (!isDetached[i] && positions[i] < passed)
+				{
+					passed = positions[i];
+				}
+			}
+
+			return passed;
+		}
+
+		// detaches the readers that have passed none of the items if another reader has passed them all,
+		// while passed items wait to be popped no reader is behind by all items,
+		// returns false if there are no such readers
+		bool
+			DetachLagging()
+		{
+			auto end = first + items.size();
+			auto hasLeader = false;
+
+			for (size_t i = 0; i < positions.size(); ++i)
+			{
+				hasLeader = hasLeader || (!isDetached[i] && positions[i] == end);
+			}
+
+			// a reader is always behind by the item it is reading, so lagging takes more than one
+			if (!hasLeader || items.size() < 2 || Passed() != first)
+			{
+				return false;
+			}
+
+			for (size_t i = 0; i < positions.size(); ++i)
+			{
+				if (!isDetached[i] && positions[i] == first)
+				{
+					isDetached[i] = true;
+				}
+			}
+
+			return true;
+		}
+
+	public:
+		// maxSize of 0 does not limit the size
+		ReplayBuffer(
+			const size_t readerCount
+			, const size_t maxCount
+			, const size_t maxSize = 0
+			, const bool detachesLaggingReaders = false)
+			: first(0)
+			, count(0)
+			, size(0)
+			, maxCount(maxCount)
+			, maxSize(maxSize)
+			, positions(readerCount, 0)
+			, isDetached(readerCount, false)
+			, detachesLaggingReaders(detachesLaggingReaders)
+			, isClosed(false)
+		{
+		}
+
+		// waits while the buffer is full, returns false if the buffer is closed
+		bool
+			Push(
+				T item
+				, const size_t itemCount = 1
+				, const size_t itemSize = 0)
+		{
+			unique_lock<mutex> guard(lock);
+
+			// an item larger than the limits is let into an empty buffer
+			auto HasRoom = [&]()
+			{
+				return items.empty()
+					|| (count + itemCount <= maxCount && (maxSize == 0 || size + itemSize <= maxSize));
+			};
+
+			while (!isClosed && !HasRoom())
+			{
+				// detached readers release their items when they are popped, so the room is waited for
+				if (detachesLaggingReaders && DetachLagging())
+				{
+					hasChanged.notify_all();
+				}
+
+				hasChanged.wait(guard);
+			}
+
+			if (isClosed)
+			{
+				return false;
+			}
+
+			items.push_back(std::move(item));
+			itemCountsAndSizes.push_back({ itemCount, itemSize });
+			count += itemCount;
+			size += itemSize;
+			guard.unlock();
+			hasChanged.notify_all();
+
+			return true;
+		}
+
+		// waits for the item at the reader's position and copies it to item without passing it,
+		// returns false when the reader is detached, or the buffer is closed and the reader has passed all items
+		bool
+			Read(
+				const size_t reader
+				, T &item)
+		{
+			unique_lock<mutex> guard(lock);
+			hasChanged.wait(guard, [&]() { return isClosed || isDetached[reader] || positions[reader] < first + items.size(); });
+
+			if (isDetached[reader] || positions[reader] == first + items.size())
+			{
+				return false;
+			}
+
+			item = items[positions[reader] - first];
 
-			return result;
+			return true;
 		}
 
+		// moves the reader past the item it has read
 		void
-			AddOne(
-				const T &item)
+			Next(
+				const size_t reader)
 		{
-			while (lock.test_and_set());
-			items.push_back(item);
-			lock.clear();
+			{
+				unique_lock<mutex> guard(lock);
+				++positions[reader];
+			}
+
+			hasChanged.notify_all();
 		}
 
 		void
-			AddOne(
-				const T &&item)
+			Detach(
+				const size_t reader)
+		{
+			{
+				unique_lock<mutex> guard(lock);
+				isDetached[reader] = true;
+			}
+
+			hasChanged.notify_all();
+		}
+
+		bool
+			IsDetached(
+				const size_t reader)
 		{
-			while (lock.test_and_set());
-			items.emplace_back(move(item));
-			lock.clear();
+			unique_lock<mutex> guard(lock);
+			return isDetached[reader];
 		}
 
-		vector<T>
-			GetAll()
+		size_t
+			AttachedCount()
+		{
+			unique_lock<mutex> guard(lock);
+			size_t attachedCount = 0;
+
+			for (size_t i = 0; i < isDetached.size(); ++i)
+			{
+				attachedCount += isDetached[i] ? 0 : 1;
+			}
+
+			return attachedCount;
+		}
+
+		// waits for items that all attached readers have passed and moves them to data, replacing its contents,
+		// dataSize receives their total size, returns false when the buffer is closed and no items are left
+		bool
+			PopPassed(
+				vector<T> &data
+				, size_t *dataSize = nullptr)
+		{
+			data.clear();
+
+			unique_lock<mutex> guard(lock);
+			hasChanged.wait(guard, [&]() { return Passed() > first || (isClosed && items.empty()); });
+
+			auto passed = Passed();
+			size_t popSize = 0;
+
+			for (; first < passed; ++first)
+			{
+				data.push_back(std::move(items.front()));
+				count -= itemCountsAndSizes.front().first;
+				popSize += itemCountsAndSizes.front().second;
+				items.pop_front();
+				itemCountsAndSizes.pop_front();
+			}
+
+			size -= popSize;
+
+			if (dataSize != nullptr)
+			{
+				*dataSize = popSize;
+			}
+
+			guard.unlock();
+			hasChanged.notify_all();
+
+			return !data.empty();
+		}
+
+		// makes Push fail and lets readers read the remaining items, can be called more than once
+		void
+			Close()
 		{
-			while (lock.test_and_set());
-			vector<T> result(move(items));
-			items = vector<T>();
-			lock.clear();
+			{
+				unique_lock<mutex> guard(lock);
+				isClosed = true;
+			}
 
-			return result;
+			hasChanged.notify_all();
 		}
 	};
 }
\ No newline at end of file
@@ -0,0 +1,217 @@
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+#include <memory>
+#include <exception>
+
+namespace Integro
+{
+	using std::vector;
+	using std::deque;
+	using std::thread;
+	using std::mutex;
+	using std::unique_lock;
+	using std::condition_variable;
+	using std::function;
+
+	// a fixed set of threads that run posted tasks in order of posting
+	class WorkerPool
+	{
+		vector<thread> threads_;
+		deque<function<void()>> tasks_;
+		mutex mutex_;
+		condition_variable hasTasks_;
+		bool isStopping_;
+
+		void
+			Work()
+		{
+			while (true)
+			{
+				function<void()> task;
+
+				{
+					unique_lock<mutex> lock(mutex_);
+					hasTasks_.wait(lock, [this]() { return isStopping_ || !tasks_.empty(); });
+
+					if (tasks_.empty())
+					{
+						return;
+					}
+
+					task = move(tasks_.front());
+					tasks_.pop_front();
+				}
+
+				task();
+			}
+		}
+
+	public:
+		WorkerPool(const WorkerPool&) = delete;
+		WorkerPool& operator=(const WorkerPool&) = delete;
+
+		explicit WorkerPool(
+			const size_t threadCount)
+			: isStopping_(false)
+		{
+			for (size_t i = 0; i < threadCount; ++i)
+			{
+				threads_.emplace_back([this]() { Work(); });
+			}
+		}
+
+		// runs the remaining tasks and joins the threads
+		~WorkerPool()
+		{
+			{
+				unique_lock<mutex> lock(mutex_);
+				isStopping_ = true;
+			}
+
+			hasTasks_.notify_all();
+
+			for (auto &t : threads_)
+			{
+				t.join();
+			}
+		}
+
+		size_t
+			Size() const
+		{
+			return threads_.size();
+		}
+
+		// tasks are expected not to throw
+		void
+			Post(
+				function<void()> task)
+		{
+			{
+				unique_lock<mutex> lock(mutex_);
+				tasks_.push_back(move(task));
+			}
+
+			hasTasks_.notify_one();
+		}
+
+		// a pool for the whole program, the calling thread is expected to be the other worker
+		static
+			WorkerPool&
+			Shared()
+		{
+			static WorkerPool pool(thread::hardware_concurrency() > 1 ? thread::hardware_concurrency() - 1 : 1);
+			return pool;
+		}
+	};
+
+	// calls Body(begin, end) for consecutive ranges of [0, count) on the pool and the calling thread,
+	// ranges are at least minRange long, so small counts run on the calling thread only,
+	// returns when all ranges are done and rethrows the first exception thrown by Body
+	inline
+		void
+		ParallelFor(
+			const size_t count
+			, function<void(size_t, size_t)> Body
+			, const size_t minRange = 256
+			, WorkerPool &pool = WorkerPool::Shared())
+	{
+		auto rangeCount = minRange == 0 ? count : count / minRange;
+		auto maxRangeCount = 4 * (pool.Size() + 1);
+
+		if (rangeCount > maxRangeCount)
+		{
+			rangeCount = maxRangeCount;
+		}
+
+		if (rangeCount < 2)
+		{
+			if (count > 0)
+			{
+				Body(0, count);
+			}
+
+			return;
+		}
+
+		// helpers may start after all ranges are taken, so they share the state
+		struct State
+		{
+			function<void(size_t, size_t)> Body;
+			size_t count;
+			size_t rangeCount;
+			std::atomic<size_t> next;
+			size_t doneCount;
+			std::exception_ptr error;
+			mutex mutex_;
+			condition_variable isDone;
+		};
+
+		auto state = std::make_shared<State>();
+		state->Body = move(Body);
+		state->count = count;
+		state->rangeCount = rangeCount;
+		state->next = 0;
+		state->doneCount = 0;
+
+		auto RunRanges = [](State &s)
+		{
+			while (true)
+			{
+				auto i = s.next++;
+
+				if (i >= s.rangeCount)
+				{
+					return;
+				}
+
+				std::exception_ptr error;
+
+				try
+				{
+					s.Body(s.count * i / s.rangeCount, s.count * (i + 1) / s.rangeCount);
+				}
+				catch (...)
+				{
+					error = std::current_exception();
+				}
+
+				unique_lock<mutex> lock(s.mutex_);
+
+				if (error != nullptr && s.error == nullptr)
+				{
+					s.error = error;
+				}
+
+				if (++s.doneCount == s.rangeCount)
+				{
+					s.isDone.notify_all();
+				}
+			}
+		};
+
+		auto helperCount = rangeCount - 1 < pool.Size() ? rangeCount - 1 : pool.Size();
+
+		for (size_t i = 0; i < helperCount; ++i)
+		{
+			pool.Post([state, RunRanges]() { RunRanges(*state); });
+		}
+
+		RunRanges(*state);
+
+		unique_lock<mutex> lock(state->mutex_);
+		state->isDone.wait(lock, [&]() { return state->doneCount == state->rangeCount; });
+
+		if (state->error != nullptr)
+		{
+			std::rethrow_exception(state->error);
+		}
+	}
+}
\ No newline at end of file